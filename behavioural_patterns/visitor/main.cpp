@@ -1,4 +1,9 @@
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../benchmarks/bench.h"
 
 // Visitor pattern (https://stackoverflow.com/questions/10116057/visitor-pattern-explanation)
 //
@@ -16,6 +21,9 @@
 // the equipmentVisitor, and the type of the object on which you 
 // call accept (i.e. the equipmentVisited subclass).
 
+//! \brief: Times the example's hot paths with the shared harness. Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
+
 
 
 // Step 1: Define the Visitor interface
@@ -33,7 +41,7 @@ public:
     virtual void accept(ShapeVisitor* visitor) = 0;
 };
 
-class Circle : public Shape 
+class Circle final : public Shape 
 {
 public:
     double radius;
@@ -46,7 +54,7 @@ public:
     }
 };
 
-class Square : public Shape 
+class Square final : public Shape 
 {
 public:
     double side;
@@ -60,7 +68,7 @@ public:
 };
 
 // Step 3: Implement concrete visitors
-class AreaVisitor : public ShapeVisitor 
+class AreaVisitor final : public ShapeVisitor 
 {
 public:
     void visitCircle(Circle* circle) override 
@@ -79,7 +87,7 @@ public:
 // Here we are adding another API for the objects.
 // We are adding new API to the shapes called "PrintName" without touching
 // the existing shape classes.
-class PrintNameVisitor : public ShapeVisitor 
+class PrintNameVisitor final : public ShapeVisitor 
 {
 public:
     void visitCircle(Circle* circle) override 
@@ -94,8 +102,14 @@ public:
 };
 
 
-int main() 
+int main(int argc, char* argv[]) 
 {
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+
     Circle circle(5.0);
     Square square(4.0);
 
@@ -111,4 +125,41 @@ int main()
 
 
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("visitor", argc, argv);
+    bench::MuteStdout mute;
+
+    const size_t count = 1000;
+    std::vector<std::unique_ptr<Shape>> shapes;
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(i & 1)
+        {
+            shapes.push_back(std::make_unique<Circle>(1.0 + i));
+        }
+        else
+        {
+            shapes.push_back(std::make_unique<Square>(1.0 + i));
+        }
+    }
+    AreaVisitor areaVisitor;
+    PrintNameVisitor printNameVisitor;
+
+    harness.run("accept area visitor", count, [&] {
+        for(auto& shape : shapes)
+        {
+            shape->accept(&areaVisitor);
+        }
+    });
+    harness.run("accept print name visitor", count, [&] {
+        for(auto& shape : shapes)
+        {
+            shape->accept(&printNameVisitor);
+        }
+    });
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+// Heap allocation counter for the examples' bench_app builds.
+//
+// Programs compiled with -DBENCH_COUNT_ALLOCATIONS (the `bench_app` targets that ask for
+// it in their Makefile) get counting replacements of the global operator new/delete;
+// benchmarks read bench::Allocations() around the code they measure. Other builds keep
+// the standard allocator and CountingAllocations() is false.
+//
+// Replacement allocation functions may not be inline, so include this header from one
+// translation unit per program only.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "bench.h"
+
+namespace bench
+{
+
+struct AllocationCount
+{
+    size_t allocations = 0;
+    size_t bytes = 0;
+};
+
+namespace detail
+{
+inline std::atomic<size_t> gAllocations{0};
+inline std::atomic<size_t> gAllocatedBytes{0};
+} // namespace detail
+
+constexpr bool CountingAllocations()
+{
+#ifdef BENCH_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+//! \returns: allocations made by the whole program so far, zero unless CountingAllocations().
+inline AllocationCount Allocations()
+{
+    return AllocationCount{detail::gAllocations.load(std::memory_order_relaxed),
+                           detail::gAllocatedBytes.load(std::memory_order_relaxed)};
+}
+
+//! \brief: Calls `body`, which handles `items` items, once more outside the timing and notes
+//!         its heap allocations per item under the harness's last case. Does nothing unless
+//!         CountingAllocations().
+template<class Body>
+void NoteAllocations(const Harness& harness, size_t items, const char* item, Body&& body)
+{
+    if(!CountingAllocations())
+    {
+        return;
+    }
+    AllocationCount before = Allocations();
+    body();
+    AllocationCount after = Allocations();
+    harness.note("%.2f allocations, %.1f bytes per %s", static_cast<double>(after.allocations - before.allocations) / items,
+                 static_cast<double>(after.bytes - before.bytes) / items, item);
+}
+
+} // namespace bench
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+
+// Not inlined, so GCC does not pair the malloc/free inside with new/delete expressions
+// and report them as mismatched at -O2.
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    bench::detail::gAllocations.fetch_add(1, std::memory_order_relaxed);
+    bench::detail::gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if(void* memory = std::malloc(size ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+#endif
@@ -0,0 +1,295 @@
+#pragma once
+
+// Shared micro benchmark harness for the pattern examples.
+//
+// Every example builds a `bench_app` (see its Makefile `bench` target) whose
+// `--harness` mode registers a few cases on a bench::Harness:
+//
+//     bench::Harness harness("proxy", argc, argv);
+//     harness.run("query direct", 1000, [&] { ... 1000 queries ... });
+//
+// Each case is run `--warmup` times untimed, then `--reps` times timed. The time per
+// item (rep time / items) is reported as median, p99 and min, on stdout and, with
+// `--json <path>`, as one JSON object per line for benchmarks/compare.
+//
+// Numbers that are not times (allocations, page faults, dropped frames, ...) are printed
+// under their case with harness.note(); they are not compared against the baseline.
+//
+// Workload sizes go through harness.scaled(). The defaults keep a full `make bench` at
+// about a minute; every example's RunHarness names the --scale that reaches the sizes it
+// was designed for (1M shapes, 10M builds, multi-GB files, ...). Such runs are long, so a
+// single repetition is usually enough:
+//
+//     ./bench_app --harness --scale 100 --reps 1 --warmup 0
+//
+// Results at a scale other than 1 are not comparable with benchmarks/baseline.jsonl.
+//
+// Options, after --harness:
+//     --reps N       timed repetitions per case (default 30)
+//     --warmup N     untimed repetitions per case (default 3)
+//     --cpu N        pin the process to CPU N before measuring
+//     --json PATH    write the results to PATH, one JSON object per case
+//     --filter TEXT  only run cases whose name contains TEXT
+//     --scale F      multiply the workload sizes by F (default 1, may be below 1)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace bench
+{
+
+//! \brief: Keeps `value` (and the work that produced it) from being optimized away.
+template<class T>
+inline void DoNotOptimize(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+//! \returns: false if pinning is not supported or `cpu` is not available.
+inline bool PinToCpu(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Swallows std::cout while alive, for examples whose classes print on every call.
+class MuteStdout
+{
+public:
+    MuteStdout() : mPrevious(std::cout.rdbuf(&mNull)) {}
+    ~MuteStdout() { std::cout.rdbuf(mPrevious); }
+
+    MuteStdout(const MuteStdout&) = delete;
+    MuteStdout& operator=(const MuteStdout&) = delete;
+
+private:
+    class NullBuffer final : public std::streambuf
+    {
+    protected:
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+    };
+
+    NullBuffer mNull;
+    std::streambuf* mPrevious;
+};
+
+struct Options
+{
+    size_t warmup = 3;
+    size_t reps = 30;
+    int cpu = -1;
+    std::string json;
+    std::string filter;
+    double scale = 1;
+};
+
+//! \brief: Reads the options following `--harness` (or all of them if it is absent).
+inline Options ParseOptions(int argc, char* argv[])
+{
+    Options options;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--harness")
+        {
+            continue;
+        }
+        else if(arg == "--reps" && hasValue)
+        {
+            options.reps = std::max<size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+        }
+        else if(arg == "--warmup" && hasValue)
+        {
+            options.warmup = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if(arg == "--cpu" && hasValue)
+        {
+            options.cpu = std::atoi(argv[++i]);
+        }
+        else if(arg == "--json" && hasValue)
+        {
+            options.json = argv[++i];
+        }
+        else if(arg == "--filter" && hasValue)
+        {
+            options.filter = argv[++i];
+        }
+        else if(arg == "--scale" && hasValue)
+        {
+            double scale = std::strtod(argv[++i], nullptr);
+            if(scale > 0)
+            {
+                options.scale = scale;
+            }
+            else
+            {
+                std::cerr << "bench: ignoring --scale " << argv[i] << ", it must be positive" << std::endl;
+            }
+        }
+        else
+        {
+            std::cerr << "bench: ignoring unknown option " << arg << std::endl;
+        }
+    }
+    return options;
+}
+
+struct Result
+{
+    std::string name;
+    size_t items;
+    size_t reps;
+    double medianNs;
+    double p99Ns;
+    double minNs;
+};
+
+class Harness
+{
+public:
+    Harness(std::string suite, int argc, char* argv[])
+        : mSuite(std::move(suite)), mOptions(ParseOptions(argc, argv))
+    {
+        if(mOptions.cpu >= 0 && !PinToCpu(mOptions.cpu))
+        {
+            std::cerr << "bench: could not pin to CPU " << mOptions.cpu << std::endl;
+        }
+        std::string unit = mOptions.scale == 1 ? " (ns/item)" : " (ns/item, scale " + FormatScale(mOptions.scale) + ")";
+        std::printf("%-44s %12s %12s %12s\n", (mSuite + unit).c_str(), "median", "p99", "min");
+    }
+
+    Harness(const Harness&) = delete;
+    Harness& operator=(const Harness&) = delete;
+
+    ~Harness()
+    {
+        writeJson();
+    }
+
+    //! \brief: Times `body`, which performs `items` operations per call.
+    template<class Body>
+    void run(const std::string& name, size_t items, Body&& body)
+    {
+        mLastRan = mOptions.filter.empty() || name.find(mOptions.filter) != std::string::npos;
+        if(!mLastRan)
+        {
+            return;
+        }
+        for(size_t i = 0; i < mOptions.warmup; ++i)
+        {
+            body();
+        }
+
+        std::vector<double> samples(mOptions.reps);
+        for(double& sample : samples)
+        {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            sample = elapsed.count() / std::max<size_t>(items, 1);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        // Nearest rank percentiles.
+        Result result{name, items, samples.size(), samples[(samples.size() - 1) / 2],
+                      samples[(samples.size() * 99 + 99) / 100 - 1], samples.front()};
+        std::printf("  %-42s %12.2f %12.2f %12.2f\n", name.c_str(), result.medianNs, result.p99Ns, result.minNs);
+        std::fflush(stdout);
+        mResults.push_back(std::move(result));
+    }
+
+    //! \brief: printf-style line under the last case, unless that case was filtered out.
+    __attribute__((format(printf, 2, 3))) void note(const char* format, ...) const
+    {
+        if(!mLastRan)
+        {
+            return;
+        }
+        std::va_list args;
+        va_start(args, format);
+        std::printf("    ");
+        std::vprintf(format, args);
+        std::printf("\n");
+        std::fflush(stdout);
+        va_end(args);
+    }
+
+    //! \returns: `items` times --scale, at least 1. Examples size their workloads with it.
+    size_t scaled(size_t items) const
+    {
+        return std::max<size_t>(1, static_cast<size_t>(items * mOptions.scale + 0.5));
+    }
+
+    const std::vector<Result>& results() const { return mResults; }
+
+private:
+    static std::string FormatScale(double scale)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%g", scale);
+        return text;
+    }
+
+    static std::string Quoted(const std::string& text)
+    {
+        std::string quoted = "\"";
+        for(char c : text)
+        {
+            if(c == '"' || c == '\\')
+            {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    void writeJson() const
+    {
+        if(mOptions.json.empty())
+        {
+            return;
+        }
+        std::ofstream out(mOptions.json);
+        if(!out)
+        {
+            std::cerr << "bench: cannot write " << mOptions.json << std::endl;
+            return;
+        }
+        for(const Result& result : mResults)
+        {
+            out << "{\"suite\":" << Quoted(mSuite) << ",\"name\":" << Quoted(result.name)
+                << ",\"items\":" << result.items << ",\"reps\":" << result.reps
+                << ",\"median_ns\":" << result.medianNs << ",\"p99_ns\":" << result.p99Ns
+                << ",\"min_ns\":" << result.minNs << "}\n";
+        }
+    }
+
+    std::string mSuite;
+    Options mOptions;
+    std::vector<Result> mResults;
+    bool mLastRan = false;
+};
+
+} // namespace bench
@@ -0,0 +1,123 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+// Compares two result files written by bench::Harness (one JSON object per line) and
+// flags every case whose median got slower than the threshold.
+//
+//     compare <baseline.jsonl> <latest.jsonl> [--threshold PERCENT]
+//
+// Exits with 1 if any case regressed, 2 on bad input.
+
+// Median ns per item, keyed by (suite, case).
+using Results = std::map<std::pair<std::string, std::string>, double>;
+
+//! \returns: the string value of `"key":"..."` in `line`, empty if absent.
+std::string StringField(const std::string& line, const std::string& key)
+{
+    size_t pos = line.find("\"" + key + "\":\"");
+    if(pos == std::string::npos)
+    {
+        return {};
+    }
+    std::string value;
+    for(pos += key.size() + 4; pos < line.size() && line[pos] != '"'; ++pos)
+    {
+        if(line[pos] == '\\' && pos + 1 < line.size())
+        {
+            ++pos;
+        }
+        value += line[pos];
+    }
+    return value;
+}
+
+//! \returns: the number value of `"key":...` in `line`, NaN if absent.
+double NumberField(const std::string& line, const std::string& key)
+{
+    size_t pos = line.find("\"" + key + "\":");
+    if(pos == std::string::npos)
+    {
+        return NAN;
+    }
+    return std::strtod(line.c_str() + pos + key.size() + 3, nullptr);
+}
+
+bool Load(const char* path, Results& results)
+{
+    std::ifstream in(path);
+    if(!in)
+    {
+        std::cerr << "compare: cannot read " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.find('{') == std::string::npos)
+        {
+            continue;
+        }
+        results[{StringField(line, "suite"), StringField(line, "name")}] = NumberField(line, "median_ns");
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "usage: compare <baseline.jsonl> <latest.jsonl> [--threshold PERCENT]" << std::endl;
+        return 2;
+    }
+    double threshold = 10.0;
+    if(argc > 4 && std::string(argv[3]) == "--threshold")
+    {
+        threshold = std::atof(argv[4]);
+    }
+
+    Results baseline;
+    Results latest;
+    if(!Load(argv[1], baseline) || !Load(argv[2], latest))
+    {
+        return 2;
+    }
+
+    size_t regressions = 0;
+    std::printf("%-14s %-40s %12s %12s %9s\n", "suite", "case (median ns/item)", "baseline", "latest", "change");
+    for(const auto& [key, median] : latest)
+    {
+        auto base = baseline.find(key);
+        if(base == baseline.end())
+        {
+            std::printf("%-14s %-40s %12s %12.2f %9s\n", key.first.c_str(), key.second.c_str(), "-",
+                        median, "new");
+            continue;
+        }
+        double change = (median - base->second) / base->second * 100.0;
+        bool regressed = change > threshold;
+        regressions += regressed;
+        std::printf("%-14s %-40s %12.2f %12.2f %+8.1f%%%s\n", key.first.c_str(), key.second.c_str(),
+                    base->second, median, change, regressed ? "  REGRESSION" : "");
+    }
+    for(const auto& [key, median] : baseline)
+    {
+        if(latest.find(key) == latest.end())
+        {
+            std::printf("%-14s %-40s %12.2f %12s %9s\n", key.first.c_str(), key.second.c_str(),
+                        median, "-", "missing");
+        }
+    }
+
+    if(regressions > 0)
+    {
+        std::printf("%zu case(s) slower than the baseline by more than %.1f%%\n", regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#!/bin/sh
+# Devirtualization report for the decorator, visitor and proxy chains.
+#
+#   make devirt-report        writes benchmarks/DEVIRTUALIZATION.md
+#
+# Each example is built with every profile from profiles.mk while GCC dumps its GIMPLE with
+# line numbers and reports its optimizations (-fopt-info). Only calls through the example's
+# own interfaces are counted, and they are counted per source location (call site), because
+# inlining copies one site into every caller and each copy is optimized on its own:
+#   virtual call sites   sites of virtual calls in the code as written (.gimple dump)
+#   no virtual call left sites without a virtual call in the optimized code (.optimized
+#                        dump): every copy was devirtualized or removed
+#   direct in some copy  sites where GCC proved the target of at least one copy and calls
+#                        it directly ("folding virtual function call", "devirtualizing call")
+#   guarded in some copy sites where at least one copy became "if the target is X call X
+#                        directly" (speculative devirtualization, or indirect call promotion
+#                        from the PGO profile), the virtual call stays as fallback
+# The harness cases of the same binaries are then timed RUNS times each, taking turns, so a
+# slow stretch of the machine hits every profile instead of the one being timed at the time.
+# A cell shows the median of the runs' medians and, in brackets, the lowest and highest run
+# median; a difference inside that range is noise.
+#
+# Everything is built in a temporary copy of the example and the shared headers, so the
+# working tree (and any binaries built in it) is left alone.
+
+set -e
+cd "$(dirname "$0")/.."
+
+REPS=${REPS:-15}
+RUNS=${RUNS:-5}
+PROFILES="release lto pgo-use"
+DUMPS="-fdump-tree-gimple-lineno -fdump-tree-optimized-lineno -fopt-info-optimized"
+
+SUITES="structural_patterns/decorator behavioural_patterns/visitor structural_patterns/proxy"
+
+# Sites ("file:line:column") of the virtual calls through the interfaces $1 in the dumps $2.
+virtual_sites()
+{
+    cat $2 | grep -E "OBJ_TYPE_REF\([^;]*;\((const )?(struct|class) ($1)\)[^;]*->[0-9]+B\) \(" |
+        sed -nE 's/^ *\[([^]]+)\].*/\1/p' | sort -u
+}
+
+# Sites of the -fopt-info messages in file $1 that start with one of $2.
+reported_sites()
+{
+    grep -E "^[^ :]+:[0-9]+:[0-9]+: optimized: ($2)" "$1" | cut -d: -f1-3 | sort -u
+}
+
+# Number of lines two sorted site lists $1 and $2 have in common.
+common()
+{
+    comm -12 "$1" "$2" | wc -l
+}
+
+# Median ns/item of every case in harness JSON files, as "name|median" lines.
+medians()
+{
+    sed -E 's/.*"name":"([^"]*)".*"median_ns":([0-9.e+-]+).*/\1|\2/' "$@"
+}
+
+# "median (lowest-highest)" of case $1 over the runs in files $2...
+spread()
+{
+    case=$1
+    shift
+    medians "$@" | awk -F'|' -v name="$case" '$1 == name { print $2 }' | sort -g |
+        awk '{ v[NR] = $1 } END { printf "%.2f (%.2f-%.2f)", v[int((NR + 1) / 2)], v[1], v[NR] }'
+}
+
+# Runs the harness of the debug binary and of every profile built in $1 RUNS times, taking
+# turns in each round, writing $2/debug.1.jsonl, $2/release.1.jsonl, ... $2/debug.2.jsonl, ...
+time_runs()
+{
+    run=1
+    while [ $run -le "$RUNS" ]; do
+        "$1/app" --harness --reps "$REPS" --json "$2/debug.$run.jsonl" > /dev/null
+        for profile in $PROFILES; do
+            "$1/app.$profile" --harness --reps "$REPS" --json "$2/$profile.$run.jsonl" > /dev/null
+        done
+        run=$((run + 1))
+    done
+}
+
+echo "# Devirtualization by build profile"
+echo
+echo "Generated by \`make devirt-report\` with $(g++ --version | head -n 1) on $(uname -m)."
+echo "Counts are call sites (source locations) of calls through each example's own interfaces,"
+echo "see benchmarks/devirt_report.sh for what each column counts. Timings are harness medians"
+echo "in ns per item: median of $RUNS runs of $REPS repetitions, with the lowest and highest run"
+echo "median in brackets. Differences within that range are noise."
+
+for dir in $SUITES; do
+    name=$(basename "$dir")
+    # The interfaces of the chain.
+    case $name in
+        decorator) interfaces="TextFormat|TextDecorator" ;;
+        visitor)   interfaces="Shape|ShapeVisitor" ;;
+        proxy)     interfaces="DataBaseInterface" ;;
+    esac
+    work=$(mktemp -d)
+    build="$work/$dir"
+    mkdir -p "$build" "$work/benchmarks"
+    cp "$dir"/*.cpp "$dir"/Makefile "$build"
+    cp benchmarks/*.h "$work/benchmarks"
+    cp -r tracing tests profiles.mk "$work"
+
+    make -s -C "$build" app > /dev/null 2>&1
+
+    echo
+    echo "## $name"
+    echo
+    echo "| profile | virtual call sites | no virtual call left | direct in some copy | guarded in some copy |"
+    echo "|---|---|---|---|---|"
+    for profile in $PROFILES; do
+        # Only the profile's own compile is dumped, not the instrumented training build.
+        if [ "$profile" = pgo-use ]; then
+            make -s -C "$build" pgo-gen > /dev/null 2>&1
+        fi
+        make -s -C "$build" "$profile" PROFILE_EXTRA="$DUMPS" > /dev/null 2> "$work/opt-info"
+        virtual_sites "$interfaces" "$(find "$build" -name "*.gimple" | tr '\n' ' ')" > "$work/sites"
+        virtual_sites "$interfaces" "$(find "$build" -name "*.optimized" | tr '\n' ' ')" > "$work/left"
+        reported_sites "$work/opt-info" "folding virtual function call|devirtualizing call" > "$work/direct"
+        reported_sites "$work/opt-info" "speculatively devirtualizing call|Indirect call -> direct call" > "$work/guarded"
+        echo "| $profile | $(wc -l < "$work/sites") | $(comm -23 "$work/sites" "$work/left" | wc -l) |" \
+             "$(common "$work/sites" "$work/direct") | $(common "$work/sites" "$work/guarded") |"
+        find "$build" \( -name "*.gimple" -o -name "*.optimized" \) -delete
+    done
+    time_runs "$build" "$work"
+
+    echo
+    echo "| case | debug (no flags) | $(echo $PROFILES | sed 's/ / | /g') |"
+    echo "|---|---|---|---|---|"
+    medians "$work/debug.1.jsonl" | cut -d'|' -f1 | while read -r case; do
+        row="| $case | $(spread "$case" "$work"/debug.*.jsonl)"
+        for profile in $PROFILES; do
+            row="$row | $(spread "$case" "$work/$profile".*.jsonl)"
+        done
+        echo "$row |"
+    done
+
+    rm -rf "$work"
+done
+
+# Notes on the committed run, kept by hand next to this script.
+if [ -f benchmarks/devirt_notes.md ]; then
+    echo
+    cat benchmarks/devirt_notes.md
+fi
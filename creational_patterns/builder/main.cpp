@@ -1,26 +1,87 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <malloc.h>
+#include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../../benchmarks/alloc_counter.h"
+#include "../../benchmarks/bench.h"
+#include "../../tests/check.h"
 
 // The Builder Design Pattern is a creational design pattern 
 // that is used to construct complex objects step by step. 
+//
+// build() moves the finished product out of the builder and leaves the builder empty,
+// ready for the next product, so handing a Vehicle to the client copies nothing.
+//
+// When the vehicle configuration is known at compile time, the CRTP builders
+// (StaticCarBuilder, StaticMotorcycleBuilder) produce a constexpr VehicleSpec instead:
+// no virtual calls, and options a vehicle does not support fail to compile.
+//
+// Large fleets are stored in a VehicleTable: one column per field, strings interned into
+// a SymbolTable and the options packed into one byte per vehicle.
+//
+// ParallelDirector builds batches of orders on several threads; every worker gets its own
+// builders from a factory because builders are stateful.
+
+//! \brief: Times building, fleet filtering and ParallelDirector with the shared harness;
+//!         bench_app also notes allocations per vehicle. Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
+
+//! \brief: Runs the example's self-checks. Run with `./app --check`.
+int RunChecks();
+
+// Plain description of a vehicle, usable in constant expressions.
+struct VehicleSpec
+{
+    std::string_view vehicleType;
+    std::string_view brand;
+    std::string_view model;
+    bool hasGPS = false;
+    bool hasLeatherSeats = false;
+    bool hasSunroof = false;
+};
 
 // Step 1: Define the Vehicle class
 class Vehicle 
 {
 public:
-    void setVehicleType(const std::string& type) 
+    Vehicle() = default;
+
+    explicit Vehicle(const VehicleSpec& spec)
+        : vehicleType(spec.vehicleType), brand(spec.brand), model(spec.model),
+          hasGPS(spec.hasGPS), hasLeatherSeats(spec.hasLeatherSeats), hasSunroof(spec.hasSunroof)
     {
-        vehicleType = type;
     }
 
-    void setBrand(const std::string& brand) 
+    void setVehicleType(std::string type) 
     {
-        this->brand = brand;
+        vehicleType = std::move(type);
     }
 
-    void setModel(const std::string& model) 
+    void setBrand(std::string brand) 
     {
-        this->model = model;
+        this->brand = std::move(brand);
+    }
+
+    void setModel(std::string model) 
+    {
+        this->model = std::move(model);
     }
 
     void addGPS() 
@@ -38,6 +99,12 @@ public:
         hasSunroof = true;
     }
 
+    //! \brief: Views of this vehicle's fields, valid while the vehicle is alive.
+    VehicleSpec describe() const
+    {
+        return VehicleSpec{vehicleType, brand, model, hasGPS, hasLeatherSeats, hasSunroof};
+    }
+
     void showVehicle() const 
     {
         std::cout << "Vehicle Type: " << vehicleType << "\n";
@@ -61,6 +128,8 @@ private:
 class VehicleBuilder 
 {
 public:
+    virtual ~VehicleBuilder() = default;
+
     virtual void setVehicleType() = 0;
     virtual void setBrand() = 0;
     virtual void setModel() = 0;
@@ -71,7 +140,7 @@ public:
 };
 
 // Step 3: Create concrete builders
-class CarBuilder : public VehicleBuilder 
+class CarBuilder final : public VehicleBuilder 
 {
 public:
     void setVehicleType() override 
@@ -106,14 +175,14 @@ public:
 
     Vehicle build() override 
     {
-        return vehicle;
+        return std::exchange(vehicle, Vehicle());
     }
 
 private:
     Vehicle vehicle;
 };
 
-class MotorcycleBuilder : public VehicleBuilder 
+class MotorcycleBuilder final : public VehicleBuilder 
 {
 public:
     void setVehicleType() override 
@@ -148,13 +217,28 @@ public:
 
     Vehicle build() override 
     {
-        return vehicle;
+        return std::exchange(vehicle, Vehicle());
     }
 
 private:
     Vehicle vehicle;
 };
 
+// What to build: the kind of vehicle and the options the customer asked for.
+enum class VehicleKind
+{
+    Car,
+    Motorcycle
+};
+
+struct BuildOrder
+{
+    VehicleKind kind;
+    bool gps = false;
+    bool leatherSeats = false;
+    bool sunroof = false;
+};
+
 // Step 4: Create the Director
 class VehicleDirector 
 {
@@ -172,12 +256,333 @@ public:
         return builder->build();
     }
 
+    //! \brief: Builds a vehicle with only the options requested by `order`.
+    Vehicle construct(const BuildOrder& order)
+    {
+        builder->setVehicleType();
+        builder->setBrand();
+        builder->setModel();
+        if(order.gps) builder->addGPS();
+        if(order.leatherSeats) builder->addLeatherSeats();
+        if(order.sunroof) builder->addSunroof();
+        return builder->build();
+    }
+
+    //! \brief: Constructs `count` vehicles in place into caller provided, uninitialized,
+    //!         contiguous storage (e.g. from std::allocator<Vehicle>). The caller owns and
+    //!         destroys them. If a build throws, the vehicles built so far are destroyed,
+    //!         the storage is uninitialized again and the exception propagates.
+    Vehicle* constructInto(Vehicle* storage, size_t count)
+    {
+        size_t built = 0;
+        try
+        {
+            for(; built < count; ++built)
+            {
+                new (storage + built) Vehicle(construct());
+            }
+        }
+        catch(...)
+        {
+            std::destroy_n(storage, built);
+            throw;
+        }
+        return storage;
+    }
+
 private:
     VehicleBuilder* builder;
 };
 
-int main() 
+// Builds many orders concurrently.
+//
+// Orders are split into one contiguous range per worker. Every worker creates its own
+// builders through the factory and writes its vehicles straight into its slice of the
+// preallocated output, so workers share nothing mutable.
+class ParallelDirector
+{
+public:
+    using BuilderFactory = std::function<std::unique_ptr<VehicleBuilder>(VehicleKind)>;
+
+    ParallelDirector(BuilderFactory factory, size_t threads)
+        : mFactory(std::move(factory)), mThreads(std::max<size_t>(1, threads)) {}
+
+    std::vector<Vehicle> construct(const std::vector<BuildOrder>& orders) const
+    {
+        std::vector<Vehicle> vehicles(orders.size());
+        size_t perThread = (orders.size() + mThreads - 1) / mThreads;
+
+        std::vector<std::thread> workers;
+        for(size_t t = 0; t < mThreads; ++t)
+        {
+            size_t first = std::min(orders.size(), t * perThread);
+            size_t last = std::min(orders.size(), first + perThread);
+            if(first == last)
+            {
+                break;
+            }
+            workers.emplace_back([this, &orders, &vehicles, first, last] {
+                std::unique_ptr<VehicleBuilder> carBuilder = mFactory(VehicleKind::Car);
+                std::unique_ptr<VehicleBuilder> motorcycleBuilder = mFactory(VehicleKind::Motorcycle);
+                VehicleDirector carDirector(carBuilder.get());
+                VehicleDirector motorcycleDirector(motorcycleBuilder.get());
+
+                for(size_t i = first; i < last; ++i)
+                {
+                    VehicleDirector& director = orders[i].kind == VehicleKind::Car ? carDirector : motorcycleDirector;
+                    vehicles[i] = director.construct(orders[i]);
+                }
+            });
+        }
+        for(auto& worker : workers)
+        {
+            worker.join();
+        }
+        return vehicles;
+    }
+
+private:
+    BuilderFactory mFactory;
+    size_t mThreads;
+};
+
+std::unique_ptr<VehicleBuilder> MakeBuilder(VehicleKind kind)
+{
+    if(kind == VehicleKind::Car)
+    {
+        return std::make_unique<CarBuilder>();
+    }
+    return std::make_unique<MotorcycleBuilder>();
+}
+
+// Step 5 (compile time alternative): CRTP builders with constexpr specs
+//
+// Each concrete builder only declares its fixed values and which options it supports.
+// Builders are immutable values, every step returns a new builder, so a whole chain can be
+// evaluated by the compiler. Asking for an unsupported option is a compile error.
+template<class Derived>
+class StaticVehicleBuilder
+{
+public:
+    constexpr StaticVehicleBuilder()
+        : mSpec{Derived::kVehicleType, Derived::kBrand, Derived::kModel}
+    {
+    }
+
+    constexpr Derived addGPS() const
+    {
+        static_assert(Derived::kSupportsGPS, "this vehicle cannot have GPS");
+        Derived next = self();
+        next.spec().hasGPS = true;
+        return next;
+    }
+
+    constexpr Derived addLeatherSeats() const
+    {
+        static_assert(Derived::kSupportsLeatherSeats, "this vehicle cannot have leather seats");
+        Derived next = self();
+        next.spec().hasLeatherSeats = true;
+        return next;
+    }
+
+    constexpr Derived addSunroof() const
+    {
+        static_assert(Derived::kSupportsSunroof, "this vehicle cannot have a sunroof");
+        Derived next = self();
+        next.spec().hasSunroof = true;
+        return next;
+    }
+
+    constexpr VehicleSpec build() const
+    {
+        return mSpec;
+    }
+
+private:
+    constexpr const Derived& self() const { return static_cast<const Derived&>(*this); }
+    constexpr VehicleSpec& spec() { return mSpec; }
+
+    VehicleSpec mSpec;
+};
+
+class StaticCarBuilder final : public StaticVehicleBuilder<StaticCarBuilder>
+{
+public:
+    static constexpr std::string_view kVehicleType = "Car";
+    static constexpr std::string_view kBrand = "Toyota";
+    static constexpr std::string_view kModel = "Camry";
+    static constexpr bool kSupportsGPS = true;
+    static constexpr bool kSupportsLeatherSeats = true;
+    static constexpr bool kSupportsSunroof = true;
+};
+
+class StaticMotorcycleBuilder final : public StaticVehicleBuilder<StaticMotorcycleBuilder>
+{
+public:
+    static constexpr std::string_view kVehicleType = "Motorcycle";
+    static constexpr std::string_view kBrand = "Harley-Davidson";
+    static constexpr std::string_view kModel = "Sportster";
+    static constexpr bool kSupportsGPS = false;
+    static constexpr bool kSupportsLeatherSeats = false;
+    static constexpr bool kSupportsSunroof = false;
+};
+
+// Fully specified vehicles are plain constants.
+constexpr VehicleSpec kFullyLoadedCar = StaticCarBuilder().addGPS().addLeatherSeats().addSunroof().build();
+constexpr VehicleSpec kStockMotorcycle = StaticMotorcycleBuilder().build();
+static_assert(kFullyLoadedCar.hasSunroof && !kStockMotorcycle.hasGPS, "specs are evaluated at compile time");
+
+// Unsupported options must not compile. `make check-negative` builds each of these and
+// expects the static_assert of the option to reject it.
+#if defined(BUILDER_NEGATIVE) && BUILDER_NEGATIVE == 1
+constexpr VehicleSpec kMotorcycleWithGPS = StaticMotorcycleBuilder().addGPS().build();
+#elif defined(BUILDER_NEGATIVE) && BUILDER_NEGATIVE == 2
+constexpr VehicleSpec kMotorcycleWithLeatherSeats = StaticMotorcycleBuilder().addLeatherSeats().build();
+#elif defined(BUILDER_NEGATIVE) && BUILDER_NEGATIVE == 3
+constexpr VehicleSpec kMotorcycleWithSunroof = StaticMotorcycleBuilder().addSunroof().build();
+#endif
+
+// Step 6: Compact storage for many vehicles
+
+// Maps each distinct string to a small integer id; every string is stored once.
+class SymbolTable
+{
+public:
+    using Symbol = uint32_t;
+    static constexpr Symbol kNoSymbol = ~Symbol{0};
+
+    Symbol intern(std::string_view text)
+    {
+        auto it = mIds.find(text);
+        if(it != mIds.end())
+        {
+            return it->second;
+        }
+        mNames.emplace_back(text);      // deque keeps earlier names (and the map keys) in place
+        Symbol id = static_cast<Symbol>(mNames.size() - 1);
+        mIds.emplace(mNames.back(), id);
+        return id;
+    }
+
+    Symbol find(std::string_view text) const
+    {
+        auto it = mIds.find(text);
+        return it != mIds.end() ? it->second : kNoSymbol;
+    }
+
+    std::string_view name(Symbol id) const { return mNames[id]; }
+
+    size_t memoryBytes() const
+    {
+        size_t bytes = mIds.bucket_count() * sizeof(void*) + mIds.size() * (sizeof(std::string_view) + sizeof(Symbol) + 2 * sizeof(void*));
+        for(const auto& name : mNames)
+        {
+            bytes += sizeof(std::string) + (name.size() > 15 ? name.capacity() : 0);
+        }
+        return bytes;
+    }
+
+private:
+    std::deque<std::string> mNames;
+    std::unordered_map<std::string_view, Symbol> mIds;
+};
+
+// Vehicle options as bits of a single byte.
+enum VehicleOption : uint8_t
+{
+    kOptionGPS = 1 << 0,
+    kOptionLeatherSeats = 1 << 1,
+    kOptionSunroof = 1 << 2
+};
+
+// Column oriented vehicle inventory: 3 symbols + 1 option byte per vehicle.
+class VehicleTable
+{
+public:
+    void add(const VehicleSpec& spec)
+    {
+        mTypes.push_back(mSymbols.intern(spec.vehicleType));
+        mBrands.push_back(mSymbols.intern(spec.brand));
+        mModels.push_back(mSymbols.intern(spec.model));
+        mOptions.push_back(static_cast<uint8_t>((spec.hasGPS ? kOptionGPS : 0) |
+                                                (spec.hasLeatherSeats ? kOptionLeatherSeats : 0) |
+                                                (spec.hasSunroof ? kOptionSunroof : 0)));
+    }
+
+    void add(const Vehicle& vehicle) { add(vehicle.describe()); }
+
+    size_t size() const { return mTypes.size(); }
+
+    VehicleSpec at(size_t row) const
+    {
+        return VehicleSpec{mSymbols.name(mTypes[row]), mSymbols.name(mBrands[row]), mSymbols.name(mModels[row]),
+                           (mOptions[row] & kOptionGPS) != 0,
+                           (mOptions[row] & kOptionLeatherSeats) != 0,
+                           (mOptions[row] & kOptionSunroof) != 0};
+    }
+
+    //! \brief: Counts vehicles of `vehicleType` that have all `requiredOptions`.
+    //!         Scans only the type and option columns, with no branches in the loop.
+    size_t count(std::string_view vehicleType, uint8_t requiredOptions) const
+    {
+        SymbolTable::Symbol type = mSymbols.find(vehicleType);
+        size_t matches = 0;
+        for(size_t row = 0; row < mTypes.size(); ++row)
+        {
+            matches += (mTypes[row] == type) & ((mOptions[row] & requiredOptions) == requiredOptions);
+        }
+        return matches;
+    }
+
+    //! \returns: rows of vehicles of `vehicleType` that have all `requiredOptions`.
+    std::vector<size_t> select(std::string_view vehicleType, uint8_t requiredOptions) const
+    {
+        SymbolTable::Symbol type = mSymbols.find(vehicleType);
+        std::vector<size_t> rows;
+        for(size_t row = 0; row < mTypes.size(); ++row)
+        {
+            if(mTypes[row] == type && (mOptions[row] & requiredOptions) == requiredOptions)
+            {
+                rows.push_back(row);
+            }
+        }
+        return rows;
+    }
+
+    size_t memoryBytes() const
+    {
+        return (mTypes.capacity() + mBrands.capacity() + mModels.capacity()) * sizeof(SymbolTable::Symbol) +
+               mOptions.capacity() + mSymbols.memoryBytes();
+    }
+
+    void reserve(size_t rows)
+    {
+        mTypes.reserve(rows);
+        mBrands.reserve(rows);
+        mModels.reserve(rows);
+        mOptions.reserve(rows);
+    }
+
+private:
+    SymbolTable mSymbols;
+    std::vector<SymbolTable::Symbol> mTypes;
+    std::vector<SymbolTable::Symbol> mBrands;
+    std::vector<SymbolTable::Symbol> mModels;
+    std::vector<uint8_t> mOptions;
+};
+
+int main(int argc, char* argv[]) 
 {
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return RunChecks();
+    }
+
     // Client code
     CarBuilder carBuilder;
     MotorcycleBuilder motorcycleBuilder;
@@ -193,5 +598,337 @@ int main()
     std::cout << "\nMotorcycle Details:\n";
     motorcycle.showVehicle();
 
+    std::cout << "\nCompile time Car Details:\n";
+    Vehicle(kFullyLoadedCar).showVehicle();
+
+    VehicleTable fleet;
+    fleet.add(car);
+    fleet.add(motorcycle);
+    fleet.add(kFullyLoadedCar);
+    std::cout << "\nCars with sunroof in fleet: " << fleet.count("Car", kOptionSunroof) << std::endl;
+
+    ParallelDirector parallelDirector(MakeBuilder, 2);
+    std::vector<Vehicle> batch = parallelDirector.construct({{VehicleKind::Car, true}, {VehicleKind::Motorcycle}});
+    std::cout << "\nBatch built in parallel:\n";
+    for(const auto& vehicle : batch)
+    {
+        vehicle.showVehicle();
+    }
+
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+// The previous CarBuilder: build() copies the product and the builder keeps it.
+class CopyingCarBuilder final : public VehicleBuilder
+{
+public:
+    void setVehicleType() override { vehicle.setVehicleType("Car"); }
+    void setBrand() override { vehicle.setBrand("Toyota"); }
+    void setModel() override { vehicle.setModel("Camry"); }
+    void addGPS() override { vehicle.addGPS(); }
+    void addLeatherSeats() override { vehicle.addLeatherSeats(); }
+    void addSunroof() override { vehicle.addSunroof(); }
+    Vehicle build() override { return vehicle; }
+
+private:
+    Vehicle vehicle;
+};
+
+// "Toyota" and "Camry" fit into the 15 characters std::string keeps inline (SSO), so
+// copying them allocates nothing. Catalogue data is longer: with these names every string
+// a builder copies is a heap allocation, which is what moving the product saves.
+template<bool kCopies>
+class LongNameCarBuilder final : public VehicleBuilder
+{
+public:
+    void setVehicleType() override { vehicle.setVehicleType("Passenger car, 4 doors"); }
+    void setBrand() override { vehicle.setBrand("Toyota Motor Corporation"); }
+    void setModel() override { vehicle.setModel("Camry Hybrid XLE Premium"); }
+    void addGPS() override { vehicle.addGPS(); }
+    void addLeatherSeats() override { vehicle.addLeatherSeats(); }
+    void addSunroof() override { vehicle.addSunroof(); }
+
+    Vehicle build() override
+    {
+        if constexpr(kCopies)
+        {
+            return vehicle;
+        }
+        else
+        {
+            return std::exchange(vehicle, Vehicle());
+        }
+    }
+
+private:
+    Vehicle vehicle;
+};
+
+//! \brief: Copying, moving, constexpr and bulk construction, with allocations per vehicle.
+//!         The short names fit SSO, the long name cases show what copying costs otherwise.
+void BenchmarkBuilds(bench::Harness& harness, size_t builds)
+{
+    CarBuilder carBuilder;
+    VehicleDirector director(&carBuilder);
+    auto moving = [&] {
+        for(size_t i = 0; i < builds; ++i)
+        {
+            bench::DoNotOptimize(director.construct());
+        }
+    };
+    harness.run("director construct, virtual builder", builds, moving);
+    bench::NoteAllocations(harness, builds, "vehicle", moving);
+
+    CopyingCarBuilder copyingBuilder;
+    VehicleDirector copyingDirector(&copyingBuilder);
+    auto copying = [&] {
+        for(size_t i = 0; i < builds; ++i)
+        {
+            bench::DoNotOptimize(copyingDirector.construct());
+        }
+    };
+    harness.run("director construct, copying builder", builds, copying);
+    bench::NoteAllocations(harness, builds, "vehicle", copying);
+
+    LongNameCarBuilder<false> longMovingBuilder;
+    LongNameCarBuilder<true> longCopyingBuilder;
+    for(VehicleBuilder* builder : {static_cast<VehicleBuilder*>(&longMovingBuilder), static_cast<VehicleBuilder*>(&longCopyingBuilder)})
+    {
+        VehicleDirector longDirector(builder);
+        auto longNames = [&] {
+            for(size_t i = 0; i < builds; ++i)
+            {
+                bench::DoNotOptimize(longDirector.construct());
+            }
+        };
+        harness.run(builder == &longMovingBuilder ? "director construct, long names, moving"
+                                                  : "director construct, long names, copying", builds, longNames);
+        bench::NoteAllocations(harness, builds, "vehicle", longNames);
+    }
+
+    auto fromSpec = [&] {
+        for(size_t i = 0; i < builds; ++i)
+        {
+            bench::DoNotOptimize(Vehicle(kFullyLoadedCar));
+        }
+    };
+    harness.run("vehicle from constexpr spec", builds, fromSpec);
+    bench::NoteAllocations(harness, builds, "vehicle", fromSpec);
+
+    std::allocator<Vehicle> allocator;
+    Vehicle* storage = allocator.allocate(builds);
+    auto bulk = [&] {
+        director.constructInto(storage, builds);
+        std::destroy_n(storage, builds);
+    };
+    harness.run("director constructInto, bulk", builds, bulk);
+    bench::NoteAllocations(harness, builds, "vehicle", bulk);
+    allocator.deallocate(storage, builds);
+}
+
+//! \brief: "All cars with sunroof" over a fleet stored as vector<Vehicle> and as a
+//!         VehicleTable, with the memory each needs per record.
+void BenchmarkFleetStorage(bench::Harness& harness, size_t records)
+{
+    const VehicleSpec models[] = {
+        {"Car", "Toyota", "Camry"}, {"Car", "Toyota", "Corolla"}, {"Car", "Volkswagen", "Golf Variant"},
+        {"Car", "Mercedes-Benz", "E-Class Estate"}, {"Motorcycle", "Harley-Davidson", "Sportster"},
+        {"Motorcycle", "Ducati", "Monster"}, {"Truck", "Mercedes-Benz", "Actros"}};
+
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<size_t> pickModel(0, std::size(models) - 1);
+    std::uniform_int_distribution<int> pickOptions(0, 7);
+
+    std::vector<Vehicle> vehicles;
+    vehicles.reserve(records);
+    VehicleTable table;
+    table.reserve(records);
+
+    size_t heapBefore = bench::Allocations().bytes;
+    for(size_t i = 0; i < records; ++i)
+    {
+        VehicleSpec spec = models[pickModel(rng)];
+        int options = spec.vehicleType == "Car" ? pickOptions(rng) : 0;
+        spec.hasGPS = options & 1;
+        spec.hasLeatherSeats = options & 2;
+        spec.hasSunroof = options & 4;
+        vehicles.emplace_back(spec);
+    }
+    size_t vectorBytes = vehicles.capacity() * sizeof(Vehicle) + (bench::Allocations().bytes - heapBefore);
+    for(const auto& vehicle : vehicles)
+    {
+        table.add(vehicle);
+    }
+
+    harness.run("filter vector<Vehicle>, per record", records, [&] {
+        size_t matches = 0;
+        for(const auto& vehicle : vehicles)
+        {
+            VehicleSpec spec = vehicle.describe();
+            matches += spec.vehicleType == "Car" && spec.hasSunroof;
+        }
+        bench::DoNotOptimize(matches);
+    });
+    if(bench::CountingAllocations())
+    {
+        harness.note("%.1f bytes per record", static_cast<double>(vectorBytes) / records);
+    }
+    harness.run("filter VehicleTable, per record", records, [&] {
+        bench::DoNotOptimize(table.count("Car", kOptionSunroof));
+    });
+    harness.note("%.1f bytes per record", static_cast<double>(table.memoryBytes()) / records);
+}
+
+//! \brief: Mixed car and motorcycle orders built by ParallelDirector on 1..all cores.
+void BenchmarkParallelDirector(bench::Harness& harness, size_t orderCount)
+{
+    std::mt19937 rng(5);
+    std::bernoulli_distribution coin(0.5);
+    std::vector<BuildOrder> orders(orderCount);
+    for(auto& order : orders)
+    {
+        order = BuildOrder{coin(rng) ? VehicleKind::Car : VehicleKind::Motorcycle, coin(rng), coin(rng), coin(rng)};
+    }
+
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> threadCounts;
+    for(size_t threads = 1; threads < cores; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(cores);
+
+    for(size_t threads : threadCounts)
+    {
+        ParallelDirector director(MakeBuilder, threads);
+        harness.run("ParallelDirector, " + std::to_string(threads) + " thread(s)", orderCount, [&] {
+            bench::DoNotOptimize(director.construct(orders));
+        });
+    }
+}
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("builder", argc, argv);
+
+    // Defaults: 1000 builds, a 100k vehicle fleet and 10k orders. The sizes this is meant
+    // for need a filter, the fleet would not fit otherwise: `--scale 10000 --filter director`
+    // builds 10M vehicles, `--scale 200 --filter filter` stores 20M (about 2 GB as
+    // vector<Vehicle>).
+    BenchmarkBuilds(harness, harness.scaled(1000));
+    BenchmarkFleetStorage(harness, harness.scaled(100000));
+    BenchmarkParallelDirector(harness, harness.scaled(10000));
+}
+
+///////////////////////////// Checks ////////////////////////////////////
+
+//! \brief: Every vehicle ParallelDirector builds must match its order, including when there
+//!         are more threads than orders. The builders are owned and deleted through
+//!         unique_ptr<VehicleBuilder>, so `make check-sanitize` also checks their destructor.
+void CheckParallelDirector()
+{
+    std::mt19937 rng(7);
+    std::bernoulli_distribution coin(0.5);
+    std::vector<BuildOrder> orders(1000);
+    for(auto& order : orders)
+    {
+        order = BuildOrder{coin(rng) ? VehicleKind::Car : VehicleKind::Motorcycle, coin(rng), coin(rng), coin(rng)};
+    }
+
+    for(size_t threads : {1, 3, 8})
+    {
+        std::vector<Vehicle> vehicles = ParallelDirector(MakeBuilder, threads).construct(orders);
+        CHECK(vehicles.size() == orders.size());
+
+        size_t mismatches = 0;
+        for(size_t i = 0; i < orders.size(); ++i)
+        {
+            VehicleSpec spec = vehicles[i].describe();
+            bool car = orders[i].kind == VehicleKind::Car;
+            mismatches += spec.vehicleType != (car ? "Car" : "Motorcycle") ||
+                          spec.hasGPS != (car && orders[i].gps) ||
+                          spec.hasLeatherSeats != (car && orders[i].leatherSeats) ||
+                          spec.hasSunroof != (car && orders[i].sunroof);
+        }
+        CHECK(mismatches == 0);
+    }
+
+    std::vector<BuildOrder> few = {{VehicleKind::Car, true}, {VehicleKind::Motorcycle}};
+    std::vector<Vehicle> vehicles = ParallelDirector(MakeBuilder, 8).construct(few);
+    CHECK(vehicles.size() == 2);
+    CHECK(vehicles[0].describe().hasGPS && vehicles[1].describe().vehicleType == "Motorcycle");
+}
+
+// Builds long-named cars and throws from the `failAt`th build().
+class FailingCarBuilder final : public VehicleBuilder
+{
+public:
+    explicit FailingCarBuilder(size_t failAt) : mFailAt(failAt) {}
+
+    void setVehicleType() override { mBuilder.setVehicleType(); }
+    void setBrand() override { mBuilder.setBrand(); }
+    void setModel() override { mBuilder.setModel(); }
+    void addGPS() override { mBuilder.addGPS(); }
+    void addLeatherSeats() override { mBuilder.addLeatherSeats(); }
+    void addSunroof() override { mBuilder.addSunroof(); }
+
+    Vehicle build() override
+    {
+        if(++mBuilds == mFailAt)
+        {
+            throw std::runtime_error("out of parts");
+        }
+        return mBuilder.build();
+    }
+
+private:
+    LongNameCarBuilder<false> mBuilder;
+    size_t mFailAt;
+    size_t mBuilds = 0;
+};
+
+//! \brief: A build that throws halfway through constructInto must leave no vehicle behind:
+//!         the heap holds what it held before (and `make check-sanitize` reports no leak).
+void CheckConstructIntoRollback()
+{
+    const size_t count = 16;
+    std::allocator<Vehicle> allocator;
+    Vehicle* storage = allocator.allocate(count);
+
+    {
+        FailingCarBuilder builder(count + 1);
+        VehicleDirector(&builder).constructInto(storage, count);
+        CHECK(storage[count - 1].describe().brand == "Toyota Motor Corporation");
+        std::destroy_n(storage, count);
+    }
+
+    // The first throw sets up the unwinder's own buffers, only the second one is measured.
+    size_t heapBefore = 0;
+    size_t throws = 0;
+    for(int attempt = 0; attempt < 2; ++attempt)
+    {
+        heapBefore = mallinfo2().uordblks;
+        FailingCarBuilder builder(count / 2);
+        try
+        {
+            VehicleDirector(&builder).constructInto(storage, count);
+        }
+        catch(const std::runtime_error&)
+        {
+            ++throws;
+        }
+    }
+    CHECK(throws == 2);
+    CHECK(mallinfo2().uordblks == heapBefore);
+
+    allocator.deallocate(storage, count);
+}
+
+int RunChecks()
+{
+    CheckParallelDirector();
+    CheckConstructIntoRollback();
+    return check::Report("builder");
+}
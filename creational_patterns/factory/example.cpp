@@ -1,5 +1,28 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../../benchmarks/alloc_counter.h"
+#include "../../benchmarks/bench.h"
+#include "../../tests/check.h"
 
 // The Factory Design Pattern is a creational design pattern that allows 
 // subclasses to alter the type of objects that will be created. 
@@ -31,6 +54,25 @@
 // of the class itself and don't require instantiation. These methods create objects 
 // based on the input parameters.
 
+// In this example PizzaFactory is table driven: every pizza type is a row of creation
+// thunks (plain function pointers) indexed by PizzaType. The built-in rows come from a
+// constexpr table, new types are appended with RegisterPizza<T>() without touching the
+// factory. Callers choose how a pizza is stored: shared_ptr, unique_ptr, a pooled handle
+// whose storage is recycled, or construction into their own storage.
+
+// KitchenPipeline runs the four Pizza steps as stages of an order processing engine,
+// each with its own workers and a bounded queue in front of it.
+
+// For a closed set of pizzas ClosedPizzaFactory returns a std::variant by value, so
+// pizzas live inline in containers and PizzaBatch serves them in per-type loops.
+
+//! \brief: Times creation, storage, serving and the kitchen with the shared harness;
+//!         bench_example also notes allocations per pizza. Run with `./bench_example --harness`.
+void RunHarness(int argc, char* argv[]);
+
+//! \brief: Runs the example's self-checks. Run with `./example --check`.
+int RunChecks();
+
 class Pizza
 {
 public:
@@ -38,10 +80,12 @@ public:
     virtual void bake() = 0;
     virtual void cut() = 0;
     virtual void box() = 0;
+    virtual ~Pizza() = default;
 };
 
-class MargheritaPizza : public Pizza
+class MargheritaPizza final : public Pizza
 {
+public:
     void prepare() override 
     {
         std::cout << "Preparing Margherita pizza" << std::endl;
@@ -63,8 +107,9 @@ class MargheritaPizza : public Pizza
     }
 };
 
-class VeggiePizza : public Pizza
+class VeggiePizza final : public Pizza
 {
+public:
     void prepare() override 
     {
         std::cout << "Preparing Veggie pizza" << std::endl;
@@ -86,33 +131,581 @@ class VeggiePizza : public Pizza
     }
 };
 
+// Recycles storage of one concrete pizza type.
+// Every thread keeps its own free list, so acquiring and releasing rarely contend. A thread
+// list holds at most kMaxCachedSlots: a thread that releases more than it acquires (the
+// consumer of a producer/consumer pair) moves a batch to a shared list, where acquiring
+// threads pick it up, and frees what the shared list has no room for.
+template<class T>
+class PizzaPool
+{
+public:
+    static constexpr size_t kMaxCachedSlots = 64;
+    static constexpr size_t kTransferBatch = kMaxCachedSlots / 2;
+    static constexpr size_t kMaxSharedSlots = 1024;
+
+    static Pizza* Acquire()
+    {
+        std::vector<void*>& freeSlots = FreeList().slots;
+        void* storage;
+        if(freeSlots.empty() && !Refill(freeSlots))
+        {
+            sSystemAllocations.fetch_add(1, std::memory_order_relaxed);
+            storage = ::operator new(sizeof(T));
+        }
+        else
+        {
+            storage = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        return new (storage) T();
+    }
+
+    static void Release(Pizza* pizza)
+    {
+        T* concrete = static_cast<T*>(pizza);
+        concrete->~T();
+        std::vector<void*>& freeSlots = FreeList().slots;
+        if(freeSlots.size() >= kMaxCachedSlots)
+        {
+            Spill(freeSlots);
+        }
+        freeSlots.push_back(concrete);
+    }
+
+    //! \returns: slots of this type taken from the system so far, on any thread.
+    static uint64_t systemAllocations() { return sSystemAllocations.load(std::memory_order_relaxed); }
+
+private:
+    struct SharedFreeList
+    {
+        std::mutex mutex;
+        std::vector<void*> slots;
+
+        ~SharedFreeList()
+        {
+            for(void* slot : slots)
+            {
+                ::operator delete(slot);
+            }
+        }
+    };
+
+    static SharedFreeList& Shared()
+    {
+        static SharedFreeList shared;
+        return shared;
+    }
+
+    //! \brief: Moves a batch from the shared list to the calling thread's list.
+    static bool Refill(std::vector<void*>& freeSlots)
+    {
+        SharedFreeList& shared = Shared();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        size_t count = std::min(kTransferBatch, shared.slots.size());
+        freeSlots.insert(freeSlots.end(), shared.slots.end() - count, shared.slots.end());
+        shared.slots.resize(shared.slots.size() - count);
+        return count > 0;
+    }
+
+    //! \brief: Moves a batch from the calling thread's list to the shared list, freeing what
+    //!         does not fit.
+    static void Spill(std::vector<void*>& freeSlots)
+    {
+        auto first = freeSlots.end() - kTransferBatch;
+        {
+            SharedFreeList& shared = Shared();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            size_t kept = std::min(kMaxSharedSlots - shared.slots.size(), kTransferBatch);
+            shared.slots.insert(shared.slots.end(), first, first + kept);
+            first += kept;
+        }
+        for(auto it = first; it != freeSlots.end(); ++it)
+        {
+            ::operator delete(*it);
+        }
+        freeSlots.resize(freeSlots.size() - kTransferBatch);
+    }
+
+    struct ThreadFreeList
+    {
+        std::vector<void*> slots;
+
+        ~ThreadFreeList()
+        {
+            for(void* slot : slots)
+            {
+                ::operator delete(slot);
+            }
+        }
+    };
+
+    static ThreadFreeList& FreeList()
+    {
+        thread_local ThreadFreeList freeList;
+        return freeList;
+    }
+
+    static inline std::atomic<uint64_t> sSystemAllocations{0};
+};
+
+// Creation thunks of one pizza type, one row of the factory table.
+struct PizzaThunks
+{
+    size_t size;
+    size_t alignment;
+    Pizza* (*constructAt)(void* storage);
+    Pizza* (*createNew)();
+    std::shared_ptr<Pizza> (*createShared)();
+    Pizza* (*acquirePooled)();
+    void (*releasePooled)(Pizza*);
+};
+
+template<class T>
+constexpr PizzaThunks ThunksFor()
+{
+    return PizzaThunks{
+        sizeof(T),
+        alignof(T),
+        [](void* storage) -> Pizza* { return new (storage) T(); },
+        []() -> Pizza* { return new T(); },
+        []() -> std::shared_ptr<Pizza> { return std::make_shared<T>(); },
+        &PizzaPool<T>::Acquire,
+        &PizzaPool<T>::Release};
+}
+
+// Returns a pooled pizza to its pool instead of deleting it.
+struct PizzaRecycler
+{
+    void (*release)(Pizza*) = nullptr;
+
+    void operator()(Pizza* pizza) const
+    {
+        release(pizza);
+    }
+};
+
+using PizzaHandle = std::unique_ptr<Pizza, PizzaRecycler>;
+
 class PizzaFactory
 {
 public:
-    enum class PizzaType
+    enum class PizzaType : size_t
     {
         MargaritaPizza,
         VeggiePizza
     };
 
-    std::shared_ptr<Pizza> CreatePizza(PizzaType type)
+    PizzaFactory() : mTable(kBuiltinPizzas.begin(), kBuiltinPizzas.end()) {}
+
+    //! \brief: Adds a new pizza type to this factory.
+    //! \returns: the PizzaType value to create it with.
+    template<class T>
+    PizzaType RegisterPizza()
+    {
+        mTable.push_back(ThunksFor<T>());
+        return static_cast<PizzaType>(mTable.size() - 1);
+    }
+
+    // Every Create* returns null for a type that was never registered.
+
+    std::shared_ptr<Pizza> CreatePizza(PizzaType type) const
+    {
+        const PizzaThunks* thunks = row(type);
+        return thunks ? thunks->createShared() : nullptr;
+    }
+
+    std::unique_ptr<Pizza> CreateUnique(PizzaType type) const
+    {
+        const PizzaThunks* thunks = row(type);
+        return std::unique_ptr<Pizza>(thunks ? thunks->createNew() : nullptr);
+    }
+
+    //! \brief: Pizza whose storage goes back to a per-type pool when the handle is dropped.
+    PizzaHandle CreatePooled(PizzaType type) const
+    {
+        const PizzaThunks* thunks = row(type);
+        if(!thunks)
+        {
+            return PizzaHandle();
+        }
+        return PizzaHandle(thunks->acquirePooled(), PizzaRecycler{thunks->releasePooled});
+    }
+
+    //! \brief: Constructs the pizza in caller provided storage of at least StorageSize(type)
+    //!         bytes, aligned to StorageAlignment(type). The caller destroys it (std::destroy_at).
+    Pizza* CreateAt(PizzaType type, void* storage) const
+    {
+        const PizzaThunks* thunks = row(type);
+        return thunks ? thunks->constructAt(storage) : nullptr;
+    }
+
+    //! \returns: 0 for a type that was never registered.
+    size_t StorageSize(PizzaType type) const
+    {
+        const PizzaThunks* thunks = row(type);
+        return thunks ? thunks->size : 0;
+    }
+
+    size_t StorageAlignment(PizzaType type) const
+    {
+        const PizzaThunks* thunks = row(type);
+        return thunks ? thunks->alignment : 0;
+    }
+
+private:
+    // Indexed by PizzaType, in declaration order.
+    static constexpr std::array<PizzaThunks, 2> kBuiltinPizzas = {
+        ThunksFor<MargheritaPizza>(),
+        ThunksFor<VeggiePizza>()};
+
+    const PizzaThunks* row(PizzaType type) const
+    {
+        size_t index = static_cast<size_t>(type);
+        return index < mTable.size() ? &mTable[index] : nullptr;
+    }
+
+    std::vector<PizzaThunks> mTable;
+};
+
+// When the set of pizzas is closed the factory can return them by value instead.
+// The variant holds the pizza inline, so orders sit contiguously in a vector and the
+// steps are called directly on the concrete (final) type instead of through a pointer.
+template<class... Pizzas>
+class ClosedPizzaFactory
+{
+    static_assert((std::is_base_of<Pizza, Pizzas>::value && ...), "every product must be a Pizza");
+
+public:
+    using Product = std::variant<Pizzas...>;
+
+    //! \brief: `type` indexes Pizzas, in PizzaType order for the built-in pizzas.
+    static Product CreatePizza(PizzaFactory::PizzaType type)
+    {
+        return kMakers.at(static_cast<size_t>(type))();
+    }
+
+private:
+    static constexpr std::array<Product (*)(), sizeof...(Pizzas)> kMakers = {
+        []() -> Product { return Product(std::in_place_type<Pizzas>); }...};
+};
+
+using VariantPizzaFactory = ClosedPizzaFactory<MargheritaPizza, VeggiePizza>;
+using PizzaVariant = VariantPizzaFactory::Product;
+
+//! \brief: Runs all four steps on a pizza held by value, dispatched with std::visit.
+template<class... Pizzas>
+void ServePizza(std::variant<Pizzas...>& pizza)
+{
+    std::visit([](auto& concrete) {
+        concrete.prepare();
+        concrete.bake();
+        concrete.cut();
+        concrete.box();
+    }, pizza);
+}
+
+// Orders grouped by type, one contiguous vector per pizza type. Serving is then a plain
+// loop of direct calls per type and step, with no per-order dispatch at all.
+template<class... Pizzas>
+class PizzaBatch
+{
+public:
+    void add(PizzaFactory::PizzaType type)
+    {
+        kAdders.at(static_cast<size_t>(type))(mColumns);
+    }
+
+    //! \brief: One pass per type, all four steps called directly on each pizza.
+    void serve()
+    {
+        std::apply([](auto&... column) { (serveColumn(column), ...); }, mColumns);
+    }
+
+    size_t size() const
+    {
+        return std::apply([](const auto&... column) { return (column.size() + ...); }, mColumns);
+    }
+
+    void clear()
+    {
+        std::apply([](auto&... column) { (column.clear(), ...); }, mColumns);
+    }
+
+    size_t memoryBytes() const
+    {
+        return std::apply([](const auto&... column) {
+            return ((column.capacity() * sizeof(typename std::decay_t<decltype(column)>::value_type)) + ...);
+        }, mColumns);
+    }
+
+private:
+    using Columns = std::tuple<std::vector<Pizzas>...>;
+
+    template<class T>
+    static void serveColumn(std::vector<T>& column)
+    {
+        for(T& pizza : column)
+        {
+            pizza.prepare();
+            pizza.bake();
+            pizza.cut();
+            pizza.box();
+        }
+    }
+
+    static constexpr std::array<void (*)(Columns&), sizeof...(Pizzas)> kAdders = {
+        [](Columns& columns) { std::get<std::vector<Pizzas>>(columns).emplace_back(); }...};
+
+    Columns mColumns;
+};
+
+// A pizza added from outside the factory
+class PepperoniPizza final : public Pizza
+{
+    void prepare() override 
+    {
+        std::cout << "Preparing Pepperoni pizza" << std::endl;
+    }
+
+    void bake() override 
+    {
+        std::cout << "Baking Pepperoni pizza" << std::endl;
+    }
+
+    void cut() override 
+    {
+        std::cout << "Cutting Pepperoni pizza" << std::endl;
+    }
+
+    void box() override 
+    {
+        std::cout << "Boxing Pepperoni pizza" << std::endl;
+    }
+};
+
+// Bounded queue between two kitchen stages, any number of producers and consumers.
+// Producers block while it is full, which is how a slow stage pushes back on the ones before it.
+template<class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : mCapacity(capacity) {}
+
+    //! \brief: Moves all of `items` into the queue, waiting for room as needed.
+    //! \returns: false if the queue was closed before everything fit.
+    bool pushBatch(std::vector<T>& items)
     {
-        switch(type)
+        size_t pushed = 0;
+        while(pushed < items.size())
         {
-            case PizzaType::MargaritaPizza:
-                return std::make_shared<MargheritaPizza>();
+            std::unique_lock<std::mutex> lock(mMutex);
+            mNotFull.wait(lock, [this] { return mItems.size() < mCapacity || mClosed; });
+            if(mClosed)
+            {
+                return false;
+            }
+            while(pushed < items.size() && mItems.size() < mCapacity)
+            {
+                mItems.push_back(std::move(items[pushed++]));
+            }
+            lock.unlock();
+            mNotEmpty.notify_all();
+        }
+        items.clear();
+        return true;
+    }
 
-            case PizzaType::VeggiePizza:
-                return std::make_shared<VeggiePizza>();
+    bool push(T item)
+    {
+        std::vector<T> items;
+        items.push_back(std::move(item));
+        return pushBatch(items);
+    }
+
+    //! \brief: Waits for at least one item, then moves up to `maxItems` into `batch`.
+    //! \returns: false once the queue is closed and drained.
+    bool popBatch(std::vector<T>& batch, size_t maxItems)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotEmpty.wait(lock, [this] { return !mItems.empty() || mClosed; });
+        if(mItems.empty())
+        {
+            return false;
+        }
+        size_t count = std::min(maxItems, mItems.size());
+        for(size_t i = 0; i < count; ++i)
+        {
+            batch.push_back(std::move(mItems.front()));
+            mItems.pop_front();
+        }
+        lock.unlock();
+        mNotFull.notify_all();
+        return true;
+    }
 
-            default:
-                return NULL;
+    //! \brief: Wakes everybody up, consumers still drain what is left.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mClosed = true;
         }
+        mNotFull.notify_all();
+        mNotEmpty.notify_all();
     }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mNotFull;
+    std::condition_variable mNotEmpty;
+    std::deque<T> mItems;
+    size_t mCapacity;
+    bool mClosed = false;
+};
+
+struct PizzaOrder
+{
+    size_t id = 0;
+    std::unique_ptr<Pizza> pizza;
+    std::chrono::steady_clock::time_point placed;
 };
 
-int main()
+// One step of the kitchen, run by its own workers.
+struct KitchenStage
 {
+    const char* name;
+    void (Pizza::*step)();
+    size_t workers;                       // concurrent capacity, e.g. the number of ovens
+    size_t batchSize;                     // orders taken per hand-off
+    std::chrono::microseconds batchSetup; // paid once per batch (preheating, opening the oven)
+};
+
+//! \returns: prepare, bake, cut and box, with `ovens` bakers and the given batch size.
+std::vector<KitchenStage> DefaultKitchenStages(size_t ovens, size_t batchSize)
+{
+    return {
+        {"prepare", &Pizza::prepare, 1, batchSize, std::chrono::microseconds(0)},
+        {"bake", &Pizza::bake, ovens, batchSize, std::chrono::microseconds(0)},
+        {"cut", &Pizza::cut, 1, batchSize, std::chrono::microseconds(0)},
+        {"box", &Pizza::box, 1, batchSize, std::chrono::microseconds(0)}};
+}
+
+// Order processing engine: every stage has its own worker pool and reads from a bounded
+// queue fed by the stage before it. Workers take orders in batches so the hand-off and the
+// batch setup are paid once per batch. When a stage falls behind its queue fills up and
+// the stages before it, and finally submit(), wait.
+class KitchenPipeline
+{
+public:
+    using OnServed = std::function<void(PizzaOrder&)>;
+
+    //! \param queueCapacity: orders that may wait in front of each stage.
+    //! \param onServed: called by the last stage for every finished order, from its workers.
+    KitchenPipeline(std::vector<KitchenStage> stages, size_t queueCapacity, OnServed onServed)
+        : mStages(std::move(stages)), mOnServed(std::move(onServed))
+    {
+        for(size_t s = 0; s < mStages.size(); ++s)
+        {
+            mQueues.push_back(std::make_unique<BoundedQueue<PizzaOrder>>(queueCapacity));
+        }
+        for(size_t s = 0; s < mStages.size(); ++s)
+        {
+            mWorkers.emplace_back();
+            for(size_t w = 0; w < std::max<size_t>(mStages[s].workers, 1); ++w)
+            {
+                mWorkers[s].emplace_back(&KitchenPipeline::runStage, this, s);
+            }
+        }
+    }
+
+    KitchenPipeline(const KitchenPipeline&) = delete;
+    KitchenPipeline& operator=(const KitchenPipeline&) = delete;
+
+    ~KitchenPipeline()
+    {
+        finish();
+    }
+
+    //! \brief: Hands an order to the first stage, waiting while that stage is backed up.
+    void submit(PizzaOrder order)
+    {
+        mQueues.front()->push(std::move(order));
+    }
+
+    //! \brief: Serves every submitted order and stops the workers. No submit() afterwards.
+    void finish()
+    {
+        if(mFinished)
+        {
+            return;
+        }
+        mFinished = true;
+        // Stage by stage, so each one drains everything its predecessor produced.
+        mQueues.front()->close();
+        for(size_t s = 0; s < mStages.size(); ++s)
+        {
+            for(std::thread& worker : mWorkers[s])
+            {
+                worker.join();
+            }
+            if(s + 1 < mStages.size())
+            {
+                mQueues[s + 1]->close();
+            }
+        }
+    }
+
+private:
+    void runStage(size_t s)
+    {
+        const KitchenStage& stage = mStages[s];
+        bool last = s + 1 == mStages.size();
+        std::vector<PizzaOrder> batch;
+        while(mQueues[s]->popBatch(batch, std::max<size_t>(stage.batchSize, 1)))
+        {
+            if(stage.batchSetup.count() > 0)
+            {
+                std::this_thread::sleep_for(stage.batchSetup);
+            }
+            for(PizzaOrder& order : batch)
+            {
+                (order.pizza.get()->*stage.step)();
+            }
+            if(last)
+            {
+                for(PizzaOrder& order : batch)
+                {
+                    mOnServed(order);
+                }
+                batch.clear();
+            }
+            else
+            {
+                mQueues[s + 1]->pushBatch(batch);
+            }
+        }
+    }
+
+    std::vector<KitchenStage> mStages;
+    OnServed mOnServed;
+    std::vector<std::unique_ptr<BoundedQueue<PizzaOrder>>> mQueues;
+    std::vector<std::vector<std::thread>> mWorkers;
+    bool mFinished = false;
+};
+
+int main(int argc, char* argv[])
+{
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return RunChecks();
+    }
+
     // Factory design pattern decouples object creation from business logic.
     auto factory = std::make_unique<PizzaFactory>();
 
@@ -128,5 +721,381 @@ int main()
     pizza2->cut();
     pizza2->box();
 
+    // New pizza types are registered, not added to a switch.
+    PizzaFactory::PizzaType pepperoni = factory->RegisterPizza<PepperoniPizza>();
+    PizzaHandle pizza3 = factory->CreatePooled(pepperoni);
+    pizza3->prepare();
+    pizza3->bake();
+    pizza3->cut();
+    pizza3->box();
+
+    // With a closed set of pizzas they can be held by value.
+    PizzaVariant pizza4 = VariantPizzaFactory::CreatePizza(PizzaFactory::PizzaType::VeggiePizza);
+    ServePizza(pizza4);
+
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+// Keeps the benchmark pizzas' work observable.
+static uint64_t gKitchenWork = 0;
+
+// Same pizzas without the printing, so the benchmark measures storage and dispatch.
+template<uint32_t Seed>
+class QuietPizza final : public Pizza
+{
+public:
+    void prepare() override { mState = mState * 31 + Seed; }
+    void bake() override { mState ^= mState >> 7; }
+    void cut() override { mState += 8; }
+    void box() override { gKitchenWork += mState; }
+
+private:
+    uint32_t mState = Seed;
+};
+
+using QuietMargherita = QuietPizza<1>;
+using QuietVeggie = QuietPizza<2>;
+
+//! \brief: Mixed order stream, the same for every variant of the benchmark.
+std::vector<PizzaFactory::PizzaType> MakeOrderStream(size_t orders)
+{
+    std::vector<PizzaFactory::PizzaType> stream(orders);
+    uint32_t state = 12345;
+    for(auto& type : stream)
+    {
+        state = state * 1103515245 + 12345;
+        type = (state >> 16) & 1 ? PizzaFactory::PizzaType::VeggiePizza : PizzaFactory::PizzaType::MargaritaPizza;
+    }
+    return stream;
+}
+
+//! \brief: Every creation path of the factory, `total` pizzas split over `threads` threads,
+//!         each pizza dropped right away.
+void BenchmarkCreations(bench::Harness& harness, size_t total, size_t threads)
+{
+    PizzaFactory factory;
+    const PizzaFactory::PizzaType margherita = factory.RegisterPizza<QuietMargherita>();
+    const PizzaFactory::PizzaType veggie = factory.RegisterPizza<QuietVeggie>();
+
+    auto measure = [&](const char* name, auto&& create) {
+        auto body = [&] {
+            std::vector<std::thread> workers;
+            for(size_t t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&, t] {
+                    for(size_t i = t; i < total; i += threads)
+                    {
+                        create(i & 1 ? veggie : margherita);
+                    }
+                });
+            }
+            for(auto& worker : workers)
+            {
+                worker.join();
+            }
+        };
+        harness.run(std::string("create ") + name + ", " + std::to_string(threads) + " thread(s)", total, body);
+        bench::NoteAllocations(harness, total, "pizza", body);
+    };
+
+    measure("shared_ptr", [&](PizzaFactory::PizzaType type) { bench::DoNotOptimize(factory.CreatePizza(type)); });
+    measure("unique_ptr", [&](PizzaFactory::PizzaType type) { bench::DoNotOptimize(factory.CreateUnique(type)); });
+    measure("pooled handle", [&](PizzaFactory::PizzaType type) { bench::DoNotOptimize(factory.CreatePooled(type)); });
+    measure("in place", [&](PizzaFactory::PizzaType type) {
+        alignas(std::max_align_t) unsigned char storage[64];
+        Pizza* pizza = factory.CreateAt(type, storage);
+        bench::DoNotOptimize(pizza);
+        std::destroy_at(pizza);
+    });
+}
+
+//! \brief: Fills a shared_ptr vector, a variant vector and a per-type batch with the same
+//!         orders, noting the bytes each holds per order.
+void BenchmarkStorage(bench::Harness& harness, const std::vector<PizzaFactory::PizzaType>& stream)
+{
+    const size_t orders = stream.size();
+    auto noteHeld = [&](size_t held) {
+        harness.note("%.1f bytes per order held", static_cast<double>(held) / orders);
+    };
+
+    PizzaFactory factory;
+    // Same slots as the built-in types, but quiet.
+    factory.RegisterPizza<QuietMargherita>();
+    factory.RegisterPizza<QuietVeggie>();
+    auto quiet = [](PizzaFactory::PizzaType type) { return static_cast<PizzaFactory::PizzaType>(static_cast<size_t>(type) + 2); };
+    std::vector<std::shared_ptr<Pizza>> pizzas;
+    size_t sharedBytes = 0;
+    harness.run("store orders, shared_ptr<Pizza>", orders, [&] {
+        pizzas.clear();
+        pizzas.shrink_to_fit();
+        size_t bytesBefore = bench::Allocations().bytes;
+        pizzas.reserve(orders);
+        for(PizzaFactory::PizzaType type : stream)
+        {
+            pizzas.push_back(factory.CreatePizza(quiet(type)));
+        }
+        sharedBytes = bench::Allocations().bytes - bytesBefore;
+    });
+    if(bench::CountingAllocations())
+    {
+        noteHeld(sharedBytes);
+    }
+
+    using Factory = ClosedPizzaFactory<QuietMargherita, QuietVeggie>;
+    std::vector<Factory::Product> variants;
+    harness.run("store orders, vector<variant>", orders, [&] {
+        variants.clear();
+        variants.reserve(orders);
+        for(PizzaFactory::PizzaType type : stream)
+        {
+            variants.push_back(Factory::CreatePizza(type));
+        }
+    });
+    noteHeld(variants.capacity() * sizeof(Factory::Product));
+
+    PizzaBatch<QuietMargherita, QuietVeggie> batch;
+    harness.run("store orders, per-type batch", orders, [&] {
+        batch.clear();
+        for(PizzaFactory::PizzaType type : stream)
+        {
+            batch.add(type);
+        }
+    });
+    noteHeld(batch.memoryBytes());
+}
+
+// Pizza whose steps wait like the real kitchen would, without printing.
+// Waiting instead of spinning lets stage concurrency show even on a single core.
+class SimulatedPizza final : public Pizza
+{
+public:
+    static constexpr std::chrono::microseconds kPrepare{100};
+    static constexpr std::chrono::microseconds kBake{800};
+    static constexpr std::chrono::microseconds kCut{50};
+    static constexpr std::chrono::microseconds kBox{50};
+
+    void prepare() override { std::this_thread::sleep_for(kPrepare); }
+    void bake() override { std::this_thread::sleep_for(kBake); }
+    void cut() override { std::this_thread::sleep_for(kCut); }
+    void box() override { std::this_thread::sleep_for(kBox); }
+};
+
+std::vector<KitchenStage> SimulatedKitchenStages(size_t preparers, size_t ovens, size_t batchSize)
+{
+    std::vector<KitchenStage> stages = DefaultKitchenStages(ovens, batchSize);
+    stages[0].workers = preparers;
+    // Opening the oven costs the same for one pizza as for a full rack.
+    stages[1].batchSetup = std::chrono::microseconds(400);
+    return stages;
+}
+
+void NoteLatencies(const bench::Harness& harness, std::vector<double> latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    harness.note("latency p50 %.2f ms, p99 %.2f ms (last rep)", latencies[latencies.size() / 2] * 1e3,
+                 latencies[latencies.size() * 99 / 100] * 1e3);
+}
+
+//! \brief: The loop main uses, every order through all steps before the next one starts.
+void BenchmarkSerialKitchen(bench::Harness& harness, size_t orders)
+{
+    std::vector<KitchenStage> stages = SimulatedKitchenStages(1, 1, 1);
+    std::vector<double> latencies(orders);
+    harness.run("kitchen, serial loop", orders, [&] {
+        for(size_t i = 0; i < orders; ++i)
+        {
+            auto placed = std::chrono::steady_clock::now();
+            std::unique_ptr<Pizza> pizza = std::make_unique<SimulatedPizza>();
+            for(const KitchenStage& stage : stages)
+            {
+                if(stage.batchSetup.count() > 0)
+                {
+                    std::this_thread::sleep_for(stage.batchSetup);
+                }
+                (pizza.get()->*stage.step)();
+            }
+            latencies[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - placed).count();
+        }
+    });
+    NoteLatencies(harness, latencies);
+}
+
+//! \brief: Latency runs from submit(), so time spent blocked by back-pressure counts.
+void BenchmarkPipelineKitchen(bench::Harness& harness, size_t orders, size_t preparers, size_t ovens, size_t batchSize)
+{
+    std::vector<double> latencies(orders);
+    std::string name = "kitchen, " + std::to_string(preparers) + " preparer(s), " + std::to_string(ovens) +
+                       " oven(s), batch " + std::to_string(batchSize);
+    harness.run(name, orders, [&] {
+        KitchenPipeline kitchen(SimulatedKitchenStages(preparers, ovens, batchSize), 4 * batchSize,
+                                [&](PizzaOrder& order) {
+                                    latencies[order.id] = std::chrono::duration<double>(
+                                        std::chrono::steady_clock::now() - order.placed).count();
+                                });
+        for(size_t i = 0; i < orders; ++i)
+        {
+            kitchen.submit(PizzaOrder{i, std::make_unique<SimulatedPizza>(), std::chrono::steady_clock::now()});
+        }
+        kitchen.finish();
+    });
+    NoteLatencies(harness, latencies);
+}
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("factory", argc, argv);
+
+    // 100k creations and orders by default, `--scale 100` runs 10M of each.
+    const size_t creations = harness.scaled(100000);
+    PizzaFactory factory;
+    const PizzaFactory::PizzaType margherita = factory.RegisterPizza<QuietMargherita>();
+    auto createShared = [&] {
+        for(size_t i = 0; i < creations; ++i)
+        {
+            bench::DoNotOptimize(factory.CreatePizza(margherita));
+        }
+    };
+    harness.run("create shared_ptr", creations, createShared);
+    bench::NoteAllocations(harness, creations, "pizza", createShared);
+    auto createPooled = [&] {
+        for(size_t i = 0; i < creations; ++i)
+        {
+            bench::DoNotOptimize(factory.CreatePooled(margherita));
+        }
+    };
+    harness.run("create pooled handle", creations, createPooled);
+    bench::NoteAllocations(harness, creations, "pizza", createPooled);
+    harness.run("create variant", creations, [&] {
+        for(size_t i = 0; i < creations; ++i)
+        {
+            bench::DoNotOptimize(ClosedPizzaFactory<QuietMargherita, QuietVeggie>::CreatePizza(PizzaFactory::PizzaType::MargaritaPizza));
+        }
+    });
+    for(size_t threads : {1, 2, 4, 8, 16, 32})
+    {
+        BenchmarkCreations(harness, creations, threads);
+    }
+
+    const size_t orders = harness.scaled(100000);
+    std::vector<PizzaFactory::PizzaType> stream = MakeOrderStream(orders);
+    std::vector<std::unique_ptr<Pizza>> pizzas;
+    std::vector<ClosedPizzaFactory<QuietMargherita, QuietVeggie>::Product> variants;
+    PizzaBatch<QuietMargherita, QuietVeggie> batch;
+    for(PizzaFactory::PizzaType type : stream)
+    {
+        if(type == PizzaFactory::PizzaType::VeggiePizza)
+        {
+            pizzas.push_back(std::make_unique<QuietVeggie>());
+        }
+        else
+        {
+            pizzas.push_back(std::make_unique<QuietMargherita>());
+        }
+        variants.push_back(ClosedPizzaFactory<QuietMargherita, QuietVeggie>::CreatePizza(type));
+        batch.add(type);
+    }
+    harness.run("serve, virtual calls", orders, [&] {
+        for(auto& pizza : pizzas)
+        {
+            pizza->prepare();
+            pizza->bake();
+            pizza->cut();
+            pizza->box();
+        }
+    });
+    harness.run("serve, visit variant", orders, [&] {
+        for(auto& pizza : variants)
+        {
+            ServePizza(pizza);
+        }
+    });
+    harness.run("serve, per-type batch", orders, [&] { batch.serve(); });
+    BenchmarkStorage(harness, stream);
+    bench::DoNotOptimize(gKitchenWork);
+
+    const size_t kitchenOrders = 64;
+    BenchmarkSerialKitchen(harness, kitchenOrders);
+    BenchmarkPipelineKitchen(harness, kitchenOrders, 1, 1, 1);
+    BenchmarkPipelineKitchen(harness, kitchenOrders, 1, 1, 8);
+    BenchmarkPipelineKitchen(harness, kitchenOrders, 1, 4, 1);
+    BenchmarkPipelineKitchen(harness, kitchenOrders, 1, 4, 8);
+    BenchmarkPipelineKitchen(harness, kitchenOrders, 2, 8, 8);
+}
+
+///////////////////////////// Checks ////////////////////////////////////
+
+// One thread creates every pooled pizza, another drops them. Before the thread lists were
+// capped, every released slot piled up on the dropping thread and every creation went to
+// the system.
+void CheckCrossThreadPool()
+{
+    using CheckedPizza = QuietPizza<3>;
+    PizzaFactory factory;
+    const PizzaFactory::PizzaType type = factory.RegisterPizza<CheckedPizza>();
+    const size_t pizzas = 100000;
+    const size_t inFlight = 16;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<PizzaHandle> handedOver;
+    bool done = false;
+
+    std::thread consumer([&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;)
+        {
+            changed.wait(lock, [&] { return !handedOver.empty() || done; });
+            if(handedOver.empty())
+            {
+                return;
+            }
+            std::vector<PizzaHandle> served;
+            served.swap(handedOver);
+            lock.unlock();
+            changed.notify_all();
+            served.clear();
+            lock.lock();
+        }
+    });
+
+    size_t created = 0;
+    for(size_t i = 0; i < pizzas; ++i)
+    {
+        PizzaHandle pizza = factory.CreatePooled(type);
+        created += pizza != nullptr;
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return handedOver.size() < inFlight; });
+        handedOver.push_back(std::move(pizza));
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    changed.notify_all();
+    consumer.join();
+
+    CHECK(created == pizzas);
+    // In flight, plus what both threads' lists and the shared list may hold.
+    using Pool = PizzaPool<CheckedPizza>;
+    const size_t bound = inFlight + 2 * Pool::kMaxCachedSlots + Pool::kMaxSharedSlots;
+    CHECK(Pool::systemAllocations() <= bound);
+}
+
+void CheckUnknownTypes()
+{
+    PizzaFactory factory;
+    const auto unknown = static_cast<PizzaFactory::PizzaType>(42);
+    CHECK(factory.CreatePizza(unknown) == nullptr);
+    CHECK(factory.CreateUnique(unknown) == nullptr);
+    CHECK(factory.CreatePooled(unknown) == nullptr);
+}
+
+int RunChecks()
+{
+    CheckCrossThreadPool();
+    CheckUnknownTypes();
+    return check::Report("factory");
+}
@@ -1,6 +1,27 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <malloc.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../../benchmarks/alloc_counter.h"
+#include "../../benchmarks/bench.h"
+#include "../../tests/check.h"
 
 // Prototype - Creational design pattern
 //
@@ -10,18 +31,96 @@
 //      useful when the cost of object creation is more expensive in terms 
 //      of time and resources, and you want to create new objects that are 
 //      similar to existing ones
+//
+//      Document fields are stored as CowString: a clone shares the prototype's header,
+//      footer and content and only gets its own copy of a field once it changes it, so
+//      cloning costs a few reference count increments instead of copying every string.
+//
+//      The registry hands clones out as DocumentHandle objects whose storage comes from a
+//      per-type DocumentPool and goes back to it when the handle is released, so steady
+//      state cloning does not allocate. A handle keeps its pool alive, so it may outlive
+//      the registry or a replaced template. The registry itself is safe to read from any
+//      number of threads without locks while templates are being replaced.
+//
+//      When documents are only needed as output, BatchRenderer renders a template with
+//      many payloads into one buffer without creating clones at all.
+
+//! \brief: Times cloning, registry lookups and batch rendering with the shared harness.
+//!         Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
+
+//! \brief: Runs the example's self-checks. Run with `./app --check`.
+int RunChecks();
+
+// Reference counted, copy-on-write string.
+// Copies share one buffer; the first modification through edit() of a shared buffer gives
+// the modifying copy its own buffer. Like std::string, different copies may be used from
+// different threads, but one CowString must not be edited while it is being read or copied.
+class CowString
+{
+public:
+    CowString() : mText(Empty()) {}
+    CowString(std::string text) : mText(std::make_shared<std::string>(std::move(text))) {}
+
+    const std::string& get() const { return *mText; }
+
+    void assign(std::string text)
+    {
+        mText = std::make_shared<std::string>(std::move(text));
+    }
+
+    //! \returns: a mutable string owned by this copy only, valid until this copy is copied.
+    std::string& edit()
+    {
+        if(mText.use_count() != 1)
+        {
+            mText = std::make_shared<std::string>(*mText);
+        }
+        else
+        {
+            // The last other owner may have just released the buffer on another thread:
+            // order its reads before our writes (the release decrement pairs with this).
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *mText;
+    }
+
+    bool sharesBufferWith(const CowString& other) const { return mText == other.mText; }
+
+private:
+    // Shared by every empty CowString, so it is never unique and edit() always copies it.
+    static const std::shared_ptr<std::string>& Empty()
+    {
+        static const auto empty = std::make_shared<std::string>();
+        return empty;
+    }
+
+    std::shared_ptr<std::string> mText;
+};
 
 // Step 1: Define the Document Prototype Interface
 class DocumentPrototype 
 {
 public:
     virtual DocumentPrototype* clone() const = 0;
+
+    //! \brief: Copy constructs the clone into `storage` of at least objectSize() bytes.
+    virtual DocumentPrototype* cloneInto(void* storage) const = 0;
+    virtual size_t objectSize() const = 0;
+
     virtual void fillContent(const std::string& content) = 0;
+    virtual void appendContent(const std::string& more) = 0;
     virtual void print() const = 0;
+
+    //! \brief: Renders the template with `content` as print() would, without cloning.
+    //!         renderInto writes exactly renderedSize(content) bytes and returns the end.
+    virtual size_t renderedSize(std::string_view content) const = 0;
+    virtual char* renderInto(char* out, std::string_view content) const = 0;
+    virtual ~DocumentPrototype() = default;
 };
 
 // Step 2: Create Concrete Document Prototypes
-class Letter : public DocumentPrototype 
+class Letter final : public DocumentPrototype 
 {
 public:
     Letter() : header_("Letter Header"), footer_("Letter Footer"), content_("") 
@@ -29,30 +128,67 @@ public:
 
     }
 
+    Letter(std::string header, std::string footer) : header_(std::move(header)), footer_(std::move(footer))
+    {
+
+    }
+
     DocumentPrototype* clone() const override 
     {
         return new Letter(*this);
     }
 
+    DocumentPrototype* cloneInto(void* storage) const override
+    {
+        return new (storage) Letter(*this);
+    }
+
+    size_t objectSize() const override
+    {
+        return sizeof(Letter);
+    }
+
     void fillContent(const std::string& content) override 
     {
-        content_ = content;
+        content_.assign(content);
+    }
+
+    //! \brief: Extends the content in place, copying it first if it is shared with a clone.
+    void appendContent(const std::string& more) override
+    {
+        content_.edit() += more;
     }
 
     void print() const override 
     {
-        std::cout << header_ << std::endl;
-        std::cout << content_ << std::endl;
-        std::cout << footer_ << std::endl;
+        std::cout << header_.get() << std::endl;
+        std::cout << content_.get() << std::endl;
+        std::cout << footer_.get() << std::endl;
+    }
+
+    size_t renderedSize(std::string_view content) const override
+    {
+        return header_.get().size() + content.size() + footer_.get().size() + 3;
+    }
+
+    char* renderInto(char* out, std::string_view content) const override
+    {
+        out = std::copy(header_.get().begin(), header_.get().end(), out);
+        *out++ = '\n';
+        out = std::copy(content.begin(), content.end(), out);
+        *out++ = '\n';
+        out = std::copy(footer_.get().begin(), footer_.get().end(), out);
+        *out++ = '\n';
+        return out;
     }
 
 private:
-    std::string header_;
-    std::string footer_;
-    std::string content_;
+    CowString header_;
+    CowString footer_;
+    CowString content_;
 };
 
-class Report : public DocumentPrototype 
+class Report final : public DocumentPrototype 
 {
 public:
     Report() : header_("Report Header"), footer_("Report Footer"), content_("") 
@@ -60,64 +196,692 @@ public:
 
     }
 
+    Report(std::string header, std::string footer) : header_(std::move(header)), footer_(std::move(footer))
+    {
+
+    }
+
     DocumentPrototype* clone() const override 
     {
         return new Report(*this);
     }
 
+    DocumentPrototype* cloneInto(void* storage) const override
+    {
+        return new (storage) Report(*this);
+    }
+
+    size_t objectSize() const override
+    {
+        return sizeof(Report);
+    }
+
     void fillContent(const std::string& content) override 
     {
-        content_ = content;
+        content_.assign(content);
+    }
+
+    //! \brief: Extends the content in place, copying it first if it is shared with a clone.
+    void appendContent(const std::string& more) override
+    {
+        content_.edit() += more;
     }
 
     void print() const override {
-        std::cout << header_ << std::endl;
-        std::cout << content_ << std::endl;
-        std::cout << footer_ << std::endl;
+        std::cout << header_.get() << std::endl;
+        std::cout << content_.get() << std::endl;
+        std::cout << footer_.get() << std::endl;
+    }
+
+    size_t renderedSize(std::string_view content) const override
+    {
+        return header_.get().size() + content.size() + footer_.get().size() + 3;
+    }
+
+    char* renderInto(char* out, std::string_view content) const override
+    {
+        out = std::copy(header_.get().begin(), header_.get().end(), out);
+        *out++ = '\n';
+        out = std::copy(content.begin(), content.end(), out);
+        *out++ = '\n';
+        out = std::copy(footer_.get().begin(), footer_.get().end(), out);
+        *out++ = '\n';
+        return out;
     }
 
 private:
-    std::string header_;
-    std::string footer_;
-    std::string content_;
+    CowString header_;
+    CowString footer_;
+    CowString content_;
+};
+
+// Recycles the storage of documents of one concrete type.
+//
+// Every thread keeps its own free list per pool, so Allocate/Release usually never
+// contend. A slot released on another thread joins that thread's free list. A thread's list
+// holds at most kMaxCachedSlots: beyond that a batch moves to a list shared by all threads
+// (under a mutex), where a thread with an empty list picks it up again. The shared list is
+// capped as well and frees what does not fit, so a thread that only releases what another
+// thread allocates cannot hoard memory. Thread lists are freed when their thread exits.
+//
+// Pool ids index the thread lists and are reused once a pool is destroyed. Each list
+// remembers which pool generation filled it, so slots a thread still holds for a destroyed
+// pool are freed the first time it uses that id again.
+//
+// A pool is reference counted: its Owner holds one reference and every slot handed out
+// holds another, so it is destroyed by whichever goes last, the owner or the last slot.
+class DocumentPool
+{
+public:
+    static constexpr size_t kMaxCachedSlots = 64;
+    static constexpr size_t kTransferBatch = kMaxCachedSlots / 2;
+    static constexpr size_t kMaxSharedSlots = 1024;
+
+    struct Unreferencer
+    {
+        void operator()(DocumentPool* pool) const { pool->Unreference(); }
+    };
+    using Owner = std::unique_ptr<DocumentPool, Unreferencer>;
+
+    static Owner Create(size_t slotSize)
+    {
+        return Owner(new DocumentPool(slotSize));
+    }
+
+    DocumentPool(const DocumentPool&) = delete;
+    DocumentPool& operator=(const DocumentPool&) = delete;
+
+    void* Allocate()
+    {
+        mReferences.fetch_add(1, std::memory_order_relaxed);
+        std::vector<void*>& freeSlots = FreeList();
+        if(freeSlots.empty() && !Refill(freeSlots))
+        {
+            mSystemAllocations.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(mSlotSize);
+        }
+        void* slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    void Release(void* slot)
+    {
+        std::vector<void*>& freeSlots = FreeList();
+        if(freeSlots.size() >= kMaxCachedSlots)
+        {
+            Spill(freeSlots);
+        }
+        freeSlots.push_back(slot);
+        // Last access to the pool, which is destroyed here if the owner is already gone.
+        Unreference();
+    }
+
+    size_t slotSize() const { return mSlotSize; }
+
+    //! \returns: slots handed out and not released yet. Only meaningful to the owner.
+    uint64_t outstanding() const { return mReferences.load(std::memory_order_acquire) - 1; }
+
+    //! \returns: slots taken from the system so far.
+    uint64_t systemAllocations() const { return mSystemAllocations.load(std::memory_order_relaxed); }
+
+    //! \returns: highest pool id in use plus one, the length of every thread's list table.
+    static size_t IdsInUse() { return Ids().count(); }
+
+private:
+    explicit DocumentPool(size_t slotSize)
+        : mSlotSize(slotSize), mId(Ids().acquire()), mGeneration(sNextGeneration.fetch_add(1) + 1) {}
+
+    ~DocumentPool()
+    {
+        for(void* slot : mShared)
+        {
+            ::operator delete(slot);
+        }
+        Ids().release(mId);
+    }
+
+    void Unreference()
+    {
+        if(mReferences.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+    }
+
+    //! \brief: Moves a batch from the shared list to the calling thread's list.
+    bool Refill(std::vector<void*>& freeSlots)
+    {
+        std::lock_guard<std::mutex> lock(mSharedMutex);
+        size_t count = std::min(kTransferBatch, mShared.size());
+        freeSlots.insert(freeSlots.end(), mShared.end() - count, mShared.end());
+        mShared.resize(mShared.size() - count);
+        return count > 0;
+    }
+
+    //! \brief: Moves a batch from the calling thread's list to the shared list, freeing what
+    //!         does not fit.
+    void Spill(std::vector<void*>& freeSlots)
+    {
+        auto first = freeSlots.end() - kTransferBatch;
+        {
+            std::lock_guard<std::mutex> lock(mSharedMutex);
+            size_t room = kMaxSharedSlots - mShared.size();
+            size_t kept = std::min(room, kTransferBatch);
+            mShared.insert(mShared.end(), first, first + kept);
+            first += kept;
+        }
+        for(auto it = first; it != freeSlots.end(); ++it)
+        {
+            ::operator delete(*it);
+        }
+        freeSlots.resize(freeSlots.size() - kTransferBatch);
+    }
+
+    struct FreeSlots
+    {
+        uint64_t generation = 0;    // of the pool the slots belong to
+        std::vector<void*> slots;
+
+        void clear()
+        {
+            for(void* slot : slots)
+            {
+                ::operator delete(slot);
+            }
+            slots.clear();
+        }
+    };
+
+    struct ThreadCache
+    {
+        std::vector<FreeSlots> freeLists;   // indexed by pool id
+
+        ~ThreadCache()
+        {
+            for(auto& freeSlots : freeLists)
+            {
+                freeSlots.clear();
+            }
+        }
+    };
+
+    std::vector<void*>& FreeList()
+    {
+        thread_local ThreadCache cache;
+        if(cache.freeLists.size() <= mId)
+        {
+            cache.freeLists.resize(mId + 1);
+        }
+        FreeSlots& freeSlots = cache.freeLists[mId];
+        if(freeSlots.generation != mGeneration)
+        {
+            freeSlots.clear();
+            freeSlots.generation = mGeneration;
+        }
+        return freeSlots.slots;
+    }
+
+    // Hands out the smallest free id, so thread list tables stay as short as possible.
+    class IdAllocator
+    {
+    public:
+        size_t acquire()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto freeId = std::find(mUsed.begin(), mUsed.end(), false);
+            size_t id = static_cast<size_t>(freeId - mUsed.begin());
+            if(freeId == mUsed.end())
+            {
+                mUsed.push_back(true);
+            }
+            else
+            {
+                *freeId = true;
+            }
+            return id;
+        }
+
+        void release(size_t id)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mUsed[id] = false;
+            while(!mUsed.empty() && !mUsed.back())
+            {
+                mUsed.pop_back();
+            }
+        }
+
+        size_t count()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mUsed.size();
+        }
+
+    private:
+        std::mutex mMutex;
+        std::vector<bool> mUsed;
+    };
+
+    static IdAllocator& Ids()
+    {
+        static IdAllocator ids;
+        return ids;
+    }
+
+    static inline std::atomic<uint64_t> sNextGeneration{0};
+
+    size_t mSlotSize;
+    size_t mId;
+    uint64_t mGeneration;
+    std::atomic<uint64_t> mReferences{1};    // the owner's plus one per slot handed out
+    std::atomic<uint64_t> mSystemAllocations{0};
+
+    std::mutex mSharedMutex;
+    std::vector<void*> mShared;
+};
+
+// Owning handle to a pooled clone. Destroys the document and recycles its storage. The
+// slot holds a reference to its pool, so the pool outlives the handle.
+class DocumentHandle
+{
+public:
+    DocumentHandle() = default;
+    DocumentHandle(DocumentPrototype* document, DocumentPool* pool) : mDocument(document), mPool(pool) {}
+
+    DocumentHandle(DocumentHandle&& other) noexcept
+        : mDocument(std::exchange(other.mDocument, nullptr)), mPool(other.mPool) {}
+
+    DocumentHandle& operator=(DocumentHandle&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            mDocument = std::exchange(other.mDocument, nullptr);
+            mPool = other.mPool;
+        }
+        return *this;
+    }
+
+    ~DocumentHandle()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        if(mDocument)
+        {
+            mDocument->~DocumentPrototype();
+            mPool->Release(mDocument);
+            mDocument = nullptr;
+        }
+    }
+
+    DocumentPrototype* get() const { return mDocument; }
+    DocumentPrototype* operator->() const { return mDocument; }
+    explicit operator bool() const { return mDocument != nullptr; }
+
+private:
+    DocumentPrototype* mDocument = nullptr;
+    DocumentPool* mPool = nullptr;
+};
+
+// Process wide index of the calling thread, recycled when the thread exits.
+// Used to give every reader thread its own slot in the registry's reader table.
+class ReaderThreadIndex
+{
+public:
+    static constexpr size_t kMaxThreads = 256;
+
+    static size_t Get()
+    {
+        thread_local Holder holder;
+        return holder.index;
+    }
+
+private:
+    struct Holder
+    {
+        size_t index;
+
+        Holder()
+        {
+            std::lock_guard<std::mutex> lock(Mutex());
+            if(!FreeIndices().empty())
+            {
+                index = FreeIndices().back();
+                FreeIndices().pop_back();
+            }
+            else
+            {
+                index = NextIndex()++;
+            }
+            if(index >= kMaxThreads)
+            {
+                throw std::runtime_error("too many concurrent registry reader threads");
+            }
+        }
+
+        ~Holder()
+        {
+            std::lock_guard<std::mutex> lock(Mutex());
+            FreeIndices().push_back(index);
+        }
+    };
+
+    static std::mutex& Mutex() { static std::mutex mutex; return mutex; }
+    static std::vector<size_t>& FreeIndices() { static std::vector<size_t> indices; return indices; }
+    static size_t& NextIndex() { static size_t next = 0; return next; }
 };
 
 // Step 3: Create a Document Template Registry to manage prototypes
+//
+// Readers never lock: lookups run against an immutable snapshot published through an
+// atomic pointer. Writers copy the snapshot, change the copy and swap it in. The old
+// snapshot is reclaimed once no reader can still be using it (epoch based reclamation:
+// every reader announces the epoch it started in, in its own cache line).
+//
+// Lookups take a std::string_view, or a TemplateId resolved once up front, which skips
+// hashing entirely. Ids stay valid across template replacements.
+//
+// A replacement keeps the template's DocumentPool when the new prototype has the same
+// object size. Otherwise it gets a new pool and the old one is retired like a snapshot: the
+// registry lets go of it once no reader can still allocate from it, and clones from it
+// keep it alive until they are released.
 class DocumentTemplateRegistry 
 {
 public:
+    using TemplateId = uint32_t;
+    static constexpr TemplateId kInvalidTemplate = ~TemplateId{0};
+
     DocumentTemplateRegistry()
     {
         // Initialize the registry with default document prototypes
-        mRegistry["letter"] = new Letter();
-        mRegistry["report"] = new Report();
+        add("letter", std::make_unique<Letter>());
+        add("report", std::make_unique<Report>());
     }
 
-    DocumentPrototype* getPrototype(const std::string& type) const 
+    DocumentTemplateRegistry(const DocumentTemplateRegistry&) = delete;
+    DocumentTemplateRegistry& operator=(const DocumentTemplateRegistry&) = delete;
+
+    ~DocumentTemplateRegistry()
+    {
+        delete mSnapshot.load();
+        for(auto& retired : mRetired)
+        {
+            delete retired.snapshot;
+        }
+    }
+
+    //! \returns: pools that were replaced but may still be in use by a reader.
+    size_t retiredPools() const
+    {
+        std::lock_guard<std::mutex> lock(mWriterMutex);
+        return mRetiredPools.size();
+    }
+
+    //! \brief: Adds the `type` template, or replaces it while readers keep running.
+    void add(std::string_view type, std::unique_ptr<DocumentPrototype> prototype)
     {
-        auto it = mRegistry.find(type);
-        if (it != mRegistry.end()) {
-            return it->second->clone();
+        std::lock_guard<std::mutex> lock(mWriterMutex);
+
+        const Snapshot* current = mSnapshot.load();
+        auto next = std::make_unique<Snapshot>(current ? current->entries : std::vector<Entry>{});
+
+        TemplateId id = current ? current->find(type) : kInvalidTemplate;
+        if(id == kInvalidTemplate)
+        {
+            id = static_cast<TemplateId>(next->entries.size());
+            next->entries.push_back(Entry{std::string(type), nullptr, nullptr});
+        }
+
+        Entry& entry = next->entries[id];
+        DocumentPool::Owner replacedPool;
+        if(!entry.pool || entry.pool->slotSize() != prototype->objectSize())
+        {
+            if(entry.pool)
+            {
+                replacedPool = std::move(mPools[id]);
+            }
+            if(mPools.size() <= id)
+            {
+                mPools.resize(id + 1);
+            }
+            mPools[id] = DocumentPool::Create(prototype->objectSize());
+            entry.pool = mPools[id].get();
         }
-        return nullptr; // Prototype not found
+        entry.prototype = std::move(prototype);
+        next->index();
+
+        const Snapshot* old = mSnapshot.exchange(next.release());
+        uint64_t epoch = mEpoch.fetch_add(1) + 1;
+        if(old)
+        {
+            mRetired.push_back(Retired{old, epoch});
+        }
+        if(replacedPool)
+        {
+            mRetiredPools.push_back(RetiredPool{std::move(replacedPool), epoch});
+        }
+        reclaim();
+    }
+
+    //! \returns: id for `type` that can be used for hash free lookups, or kInvalidTemplate.
+    TemplateId resolve(std::string_view type) const
+    {
+        ReadSection section(*this);
+        return section.snapshot->find(type);
+    }
+
+    //! \returns: pooled clone of the `type` prototype, empty if there is no such prototype.
+    DocumentHandle getPrototype(std::string_view type) const 
+    {
+        ReadSection section(*this);
+        return cloneEntry(*section.snapshot, section.snapshot->find(type));
+    }
+
+    DocumentHandle getPrototype(TemplateId id) const
+    {
+        ReadSection section(*this);
+        return cloneEntry(*section.snapshot, id);
     }
 
 private:
-    std::unordered_map<std::string, DocumentPrototype*> mRegistry;
+    struct Entry
+    {
+        std::string name;
+        std::shared_ptr<const DocumentPrototype> prototype;   // shared by snapshots until replaced
+        DocumentPool* pool;
+    };
+
+    struct Snapshot
+    {
+        explicit Snapshot(std::vector<Entry> from) : entries(std::move(from)) {}
+
+        // Keys view the names owned by `entries`, so the vector is never touched after index().
+        void index()
+        {
+            ids.clear();
+            for(TemplateId id = 0; id < entries.size(); ++id)
+            {
+                ids.emplace(entries[id].name, id);
+            }
+        }
+
+        TemplateId find(std::string_view type) const
+        {
+            auto it = ids.find(type);
+            return it != ids.end() ? it->second : kInvalidTemplate;
+        }
+
+        std::vector<Entry> entries;
+        std::unordered_map<std::string_view, TemplateId> ids;
+    };
+
+    struct Retired
+    {
+        const Snapshot* snapshot;
+        uint64_t epoch;     // readers that started in this epoch or later cannot see it
+    };
+
+    struct RetiredPool
+    {
+        DocumentPool::Owner pool;
+        uint64_t epoch;     // as for Retired, readers before it may still allocate from it
+    };
+
+    struct alignas(64) ReaderSlot
+    {
+        std::atomic<uint64_t> epoch{0};     // 0 when the reader is outside a lookup
+    };
+
+    // Pins the current snapshot for the duration of one lookup.
+    struct ReadSection
+    {
+        explicit ReadSection(const DocumentTemplateRegistry& registry)
+            : slot(registry.mReaders[ReaderThreadIndex::Get()])
+        {
+            slot.epoch.store(registry.mEpoch.load());
+            snapshot = registry.mSnapshot.load();
+        }
+
+        ~ReadSection()
+        {
+            slot.epoch.store(0, std::memory_order_release);
+        }
+
+        ReaderSlot& slot;
+        const Snapshot* snapshot;
+    };
+
+    static DocumentHandle cloneEntry(const Snapshot& snapshot, TemplateId id)
+    {
+        if(id >= snapshot.entries.size())
+        {
+            return DocumentHandle(); // Prototype not found
+        }
+        const Entry& entry = snapshot.entries[id];
+        return DocumentHandle(entry.prototype->cloneInto(entry.pool->Allocate()), entry.pool);
+    }
+
+    // Frees retired snapshots that no active reader can reference anymore.
+    void reclaim()
+    {
+        uint64_t oldestActive = ~uint64_t{0};
+        for(const auto& reader : mReaders)
+        {
+            uint64_t epoch = reader.epoch.load();
+            if(epoch != 0)
+            {
+                oldestActive = std::min(oldestActive, epoch);
+            }
+        }
+
+        auto stillVisible = [oldestActive](const Retired& retired) {
+            if(retired.epoch > oldestActive)
+            {
+                return true;
+            }
+            delete retired.snapshot;
+            return false;
+        };
+        mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+                                      [&](const Retired& retired) { return !stillVisible(retired); }),
+                       mRetired.end());
+
+        // No reader can allocate from these anymore, clones still out keep them alive.
+        mRetiredPools.erase(std::remove_if(mRetiredPools.begin(), mRetiredPools.end(),
+                                           [&](const RetiredPool& retired) { return retired.epoch <= oldestActive; }),
+                            mRetiredPools.end());
+    }
+
+    std::atomic<const Snapshot*> mSnapshot{nullptr};
+    std::atomic<uint64_t> mEpoch{1};
+    mutable ReaderSlot mReaders[ReaderThreadIndex::kMaxThreads];
+
+    // Writer side only
+    mutable std::mutex mWriterMutex;
+    std::vector<Retired> mRetired;
+    std::vector<DocumentPool::Owner> mPools;     // indexed by TemplateId
+    std::vector<RetiredPool> mRetiredPools;
 };
 
-int main() 
+// Renders one template with many content payloads into a single buffer.
+//
+// No document is cloned: every payload is rendered straight from the prototype. The
+// offset of every document is known up front, so threads render disjoint ranges in
+// place and the output keeps the order of `contents`.
+class BatchRenderer
 {
+public:
+    static std::string Render(const DocumentPrototype& prototype, const std::vector<std::string>& contents,
+                              size_t threads = 1)
+    {
+        std::vector<size_t> offsets(contents.size() + 1, 0);
+        for(size_t i = 0; i < contents.size(); ++i)
+        {
+            offsets[i + 1] = offsets[i] + prototype.renderedSize(contents[i]);
+        }
+
+        std::string buffer(offsets.back(), '\0');
+        auto renderRange = [&](size_t first, size_t last) {
+            for(size_t i = first; i < last; ++i)
+            {
+                prototype.renderInto(&buffer[offsets[i]], contents[i]);
+            }
+        };
+
+        threads = std::max<size_t>(1, std::min(threads, contents.size()));
+        std::vector<std::thread> workers;
+        size_t perThread = (contents.size() + threads - 1) / threads;
+        for(size_t t = 1; t < threads; ++t)
+        {
+            size_t first = std::min(contents.size(), t * perThread);
+            size_t last = std::min(contents.size(), first + perThread);
+            workers.emplace_back(renderRange, first, last);
+        }
+        renderRange(0, std::min(contents.size(), perThread));
+        for(auto& worker : workers)
+        {
+            worker.join();
+        }
+        return buffer;
+    }
+
+    //! \brief: Renders the whole batch and emits it with a single write.
+    static void Write(std::ostream& out, const DocumentPrototype& prototype,
+                      const std::vector<std::string>& contents, size_t threads = 1)
+    {
+        std::string buffer = Render(prototype, contents, threads);
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        out.flush();
+    }
+};
+
+int main(int argc, char* argv[]) 
+{
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return RunChecks();
+    }
+
     // Step 4: Client Code
     DocumentTemplateRegistry templateRegistry;
 
     // Clone document templates and fill content
-    DocumentPrototype* letter = templateRegistry.getPrototype("letter");
-    DocumentPrototype* report = templateRegistry.getPrototype("report");
+    DocumentHandle letter = templateRegistry.getPrototype("letter");
+    DocumentHandle report = templateRegistry.getPrototype("report");
 
     if (letter && report) 
     {
         letter->fillContent("Dear John,\n\nThis is a letter.");
+        letter->appendContent("\n\nKind regards");
         report->fillContent("Monthly Sales Report:\n\nTotal Sales: $100,000");
 
         // Print documents
@@ -134,9 +898,492 @@ int main()
         std::cout << std::endl << "---" << std::endl;
     }
 
-    // Clean up
-    delete letter;
-    delete report;
+    // Render several letters from the same template in one go
+    std::cout << "\nBatch of letters:" << std::endl;
+    Letter letterTemplate;
+    BatchRenderer::Write(std::cout, letterTemplate, {"Dear Ann,", "Dear Bob,", "Dear Eve,"});
+
+    // Handles return their documents to the registry's pools when they go out of scope
 
     return 0;
 }
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+// The previous Letter layout: every clone deep-copies all three strings.
+class DeepCopyLetter final : public DocumentPrototype
+{
+public:
+    DeepCopyLetter(std::string header, std::string footer) : header_(std::move(header)), footer_(std::move(footer)) {}
+
+    DocumentPrototype* clone() const override { return new DeepCopyLetter(*this); }
+    DocumentPrototype* cloneInto(void* storage) const override { return new (storage) DeepCopyLetter(*this); }
+    size_t objectSize() const override { return sizeof(DeepCopyLetter); }
+    void fillContent(const std::string& content) override { content_ = content; }
+    void appendContent(const std::string& more) override { content_ += more; }
+
+    void print() const override
+    {
+        std::cout << header_ << std::endl;
+        std::cout << content_ << std::endl;
+        std::cout << footer_ << std::endl;
+    }
+
+    size_t renderedSize(std::string_view content) const override
+    {
+        return header_.size() + content.size() + footer_.size() + 3;
+    }
+
+    char* renderInto(char* out, std::string_view content) const override
+    {
+        out = std::copy(header_.begin(), header_.end(), out);
+        *out++ = '\n';
+        out = std::copy(content.begin(), content.end(), out);
+        *out++ = '\n';
+        out = std::copy(footer_.begin(), footer_.end(), out);
+        *out++ = '\n';
+        return out;
+    }
+
+private:
+    std::string header_;
+    std::string footer_;
+    std::string content_;
+};
+
+//! \brief: Clones `count` documents from `prototype`, fills their content and keeps them
+//!         alive until the rep ends; notes the heap bytes per live clone.
+void BenchmarkClones(bench::Harness& harness, const std::string& name, const DocumentPrototype& prototype, size_t count)
+{
+    std::vector<std::unique_ptr<DocumentPrototype>> documents;
+    documents.reserve(count);
+    const std::string content = "Dear customer, your order has shipped.";
+    size_t heapPerClone = 0;
+
+    harness.run(name, count, [&] {
+        documents.clear();
+        size_t heapBefore = mallinfo2().uordblks;
+        for(size_t i = 0; i < count; ++i)
+        {
+            documents.emplace_back(prototype.clone());
+            documents.back()->fillContent(content);
+        }
+        heapPerClone = (mallinfo2().uordblks - heapBefore) / count;
+    });
+    harness.note("%zu heap bytes per clone", heapPerClone);
+}
+
+//! \brief: Short lived clones (look up, clone, drop) from `threads` threads at once,
+//!         comparing pooled handles with the previous lookup + new/delete registry.
+void BenchmarkCloneChurn(bench::Harness& harness, size_t threads, size_t perThread)
+{
+    DocumentTemplateRegistry registry;
+    Letter letter;
+    const std::unordered_map<std::string, DocumentPrototype*> plainRegistry{{"letter", &letter}};
+
+    auto onThreads = [&](auto&& cloneAndDrop) {
+        std::vector<std::thread> workers;
+        for(size_t t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&] {
+                for(size_t i = 0; i < perThread; ++i)
+                {
+                    cloneAndDrop();
+                }
+            });
+        }
+        for(auto& worker : workers)
+        {
+            worker.join();
+        }
+    };
+
+    std::string suffix = ", " + std::to_string(threads) + " thread(s)";
+    harness.run("clone churn, new/delete" + suffix, threads * perThread, [&] {
+        onThreads([&] {
+            std::unique_ptr<DocumentPrototype> document(plainRegistry.find("letter")->second->clone());
+            bench::DoNotOptimize(document);
+        });
+    });
+    harness.run("clone churn, pooled" + suffix, threads * perThread, [&] {
+        onThreads([&] {
+            DocumentHandle document = registry.getPrototype("letter");
+            bench::DoNotOptimize(document);
+        });
+    });
+}
+
+//! \brief: `readers` threads clone `perReader` documents each while a writer keeps
+//!         replacing the "letter" template.
+void BenchmarkRegistryReaders(bench::Harness& harness, size_t readers, size_t perReader, bool byId)
+{
+    DocumentTemplateRegistry registry;
+    const DocumentTemplateRegistry::TemplateId letterId = registry.resolve("letter");
+    uint64_t updates = 0;
+
+    std::string name = "clone by " + std::string(byId ? "id" : "name") + " during updates, " +
+                       std::to_string(readers) + " reader(s)";
+    harness.run(name, readers * perReader, [&] {
+        std::atomic<size_t> running{readers};
+        std::vector<std::thread> threads;
+        for(size_t r = 0; r < readers; ++r)
+        {
+            threads.emplace_back([&] {
+                for(size_t i = 0; i < perReader; ++i)
+                {
+                    DocumentHandle document = byId ? registry.getPrototype(letterId)
+                                                   : registry.getPrototype(std::string_view("letter"));
+                    bench::DoNotOptimize(document);
+                }
+                running.fetch_sub(1);
+            });
+        }
+        while(running.load() > 0)
+        {
+            registry.add("letter", std::make_unique<Letter>("Letter Header v" + std::to_string(++updates), "Letter Footer"));
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+    });
+    harness.note("%llu template updates in total", static_cast<unsigned long long>(updates));
+}
+
+//! \brief: Documents written to /dev/null, clone-and-print compared with BatchRenderer.
+void BenchmarkBatchRendering(bench::Harness& harness, const DocumentPrototype& prototype,
+                             const std::vector<std::string>& contents)
+{
+    std::ofstream file("/dev/null");
+
+    harness.run("clone and print, per document", contents.size(), [&] {
+        std::streambuf* console = std::cout.rdbuf(file.rdbuf());
+        for(const auto& content : contents)
+        {
+            std::unique_ptr<DocumentPrototype> document(prototype.clone());
+            document->fillContent(content);
+            document->print();
+        }
+        std::cout.rdbuf(console);
+    });
+
+    for(size_t threads : {1, 2, 4})
+    {
+        harness.run("batch render and write, " + std::to_string(threads) + " thread(s)", contents.size(), [&] {
+            std::string buffer = BatchRenderer::Render(prototype, contents, threads);
+            file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            file.flush();
+        });
+    }
+}
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("prototype", argc, argv);
+
+    // 1000 clones by default, `--scale 1000` clones 1M documents. Keeping 1M deep copies of
+    // the 32 KiB templates alive needs about 33 GB; add `--filter copy-on-write` to skip them.
+    const size_t clones = harness.scaled(1000);
+    Letter letter;
+    harness.run("clone letter, new/delete", clones, [&] {
+        for(size_t i = 0; i < clones; ++i)
+        {
+            std::unique_ptr<DocumentPrototype> document(letter.clone());
+            bench::DoNotOptimize(document);
+        }
+    });
+
+    DocumentTemplateRegistry registry;
+    const DocumentTemplateRegistry::TemplateId letterId = registry.resolve("letter");
+    harness.run("pooled clone by name", clones, [&] {
+        for(size_t i = 0; i < clones; ++i)
+        {
+            DocumentHandle document = registry.getPrototype(std::string_view("letter"));
+            bench::DoNotOptimize(document);
+        }
+    });
+    harness.run("pooled clone by id", clones, [&] {
+        for(size_t i = 0; i < clones; ++i)
+        {
+            DocumentHandle document = registry.getPrototype(letterId);
+            bench::DoNotOptimize(document);
+        }
+    });
+
+    std::vector<std::string> contents;
+    for(size_t i = 0; i < clones; ++i)
+    {
+        contents.push_back("Dear customer #" + std::to_string(i) + ", your order has shipped.");
+    }
+    harness.run("batch render, per document", contents.size(), [&] {
+        bench::DoNotOptimize(BatchRenderer::Render(letter, contents));
+    });
+    BenchmarkBatchRendering(harness, letter, contents);
+
+    // Templates with 32 KiB of header and footer: clones share them or copy them.
+    const std::string header(16 * 1024, 'H');
+    const std::string footer(16 * 1024, 'F');
+    BenchmarkClones(harness, "clone and fill, 32 KiB copy-on-write", Letter(header, footer), clones);
+    BenchmarkClones(harness, "clone and fill, 32 KiB deep copy", DeepCopyLetter(header, footer), clones);
+
+    for(size_t threads : {1, 2, 4})
+    {
+        BenchmarkCloneChurn(harness, threads, harness.scaled(10000));
+    }
+    for(size_t readers : {1, 4, 16, 64})
+    {
+        BenchmarkRegistryReaders(harness, readers, harness.scaled(20000), false);
+        BenchmarkRegistryReaders(harness, readers, harness.scaled(20000), true);
+    }
+}
+
+///////////////////////////// Checks ////////////////////////////////////
+
+//! \returns: what document.print() writes.
+std::string Printed(const DocumentPrototype& document)
+{
+    std::ostringstream out;
+    std::streambuf* console = std::cout.rdbuf(out.rdbuf());
+    document.print();
+    std::cout.rdbuf(console);
+    return out.str();
+}
+
+void CheckCopyOnWrite()
+{
+    CowString original("shared");
+    CowString copy = original;
+    CHECK(copy.sharesBufferWith(original));
+
+    copy.edit() += " and edited";
+    CHECK(original.get() == "shared");
+    CHECK(copy.get() == "shared and edited");
+    CHECK(!copy.sharesBufferWith(original));
+
+    // A unique buffer is edited in place.
+    const std::string* buffer = &copy.get();
+    copy.edit() += "!";
+    CHECK(&copy.get() == buffer);
+
+    CowString empty;
+    empty.edit() = "not empty";
+    CHECK(CowString().get().empty());
+
+    // Editing a clone of a clone leaves the documents it was cloned from unchanged.
+    Letter letter("Header", "Footer");
+    letter.fillContent("Body");
+    std::unique_ptr<DocumentPrototype> clone(letter.clone());
+    std::unique_ptr<DocumentPrototype> cloneOfClone(clone->clone());
+    cloneOfClone->appendContent(" with a postscript");
+    CHECK(Printed(letter) == "Header\nBody\nFooter\n");
+    CHECK(Printed(*clone) == "Header\nBody\nFooter\n");
+    CHECK(Printed(*cloneOfClone) == "Header\nBody with a postscript\nFooter\n");
+
+    // Clones edited on their own threads never see each other's edits.
+    std::vector<std::unique_ptr<DocumentPrototype>> clones;
+    for(size_t i = 0; i < 4; ++i)
+    {
+        clones.emplace_back(letter.clone());
+    }
+    std::vector<std::thread> editors;
+    for(size_t i = 0; i < clones.size(); ++i)
+    {
+        editors.emplace_back([&, i] {
+            for(size_t n = 0; n < 1000; ++n)
+            {
+                clones[i]->appendContent(std::to_string(i));
+            }
+        });
+    }
+    for(auto& editor : editors)
+    {
+        editor.join();
+    }
+    CHECK(Printed(letter) == "Header\nBody\nFooter\n");
+    for(size_t i = 0; i < clones.size(); ++i)
+    {
+        CHECK(Printed(*clones[i]) == "Header\nBody" + std::string(1000, static_cast<char>('0' + i)) + "\nFooter\n");
+    }
+}
+
+// One thread allocates every document, another releases them. Before the thread lists were
+// capped, every released slot piled up on the releasing thread and every allocation went
+// to the system.
+void CheckCrossThreadPool()
+{
+    DocumentPool::Owner pool = DocumentPool::Create(sizeof(Letter));
+    const size_t documents = 100000;
+    const size_t inFlight = 16;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<void*> handedOver;
+    bool done = false;
+
+    std::thread releaser([&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;)
+        {
+            changed.wait(lock, [&] { return !handedOver.empty() || done; });
+            if(handedOver.empty())
+            {
+                return;
+            }
+            std::vector<void*> slots;
+            slots.swap(handedOver);
+            lock.unlock();
+            changed.notify_all();
+            for(void* slot : slots)
+            {
+                pool->Release(slot);
+            }
+            lock.lock();
+        }
+    });
+
+    for(size_t i = 0; i < documents; ++i)
+    {
+        void* slot = pool->Allocate();
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return handedOver.size() < inFlight; });
+        handedOver.push_back(slot);
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    changed.notify_all();
+    releaser.join();
+
+    // In flight, plus what both threads' lists and the shared list may hold.
+    const size_t bound = inFlight + 2 * DocumentPool::kMaxCachedSlots + DocumentPool::kMaxSharedSlots;
+    CHECK(pool->systemAllocations() <= bound);
+    CHECK(pool->outstanding() == 0);
+}
+
+// A template reloaded with the same object size keeps its pool; one whose size changes
+// gets a new pool and the old one goes away once its last clone is released. Under
+// `make check-sanitize` a clone that touched its pool after that would be reported.
+class WideLetter final : public DocumentPrototype
+{
+public:
+    DocumentPrototype* clone() const override { return new WideLetter(*this); }
+    DocumentPrototype* cloneInto(void* storage) const override { return new (storage) WideLetter(*this); }
+    size_t objectSize() const override { return sizeof(WideLetter); }
+    void fillContent(const std::string& content) override { mLetter.fillContent(content); }
+    void appendContent(const std::string& more) override { mLetter.appendContent(more); }
+    void print() const override { mLetter.print(); }
+    size_t renderedSize(std::string_view content) const override { return mLetter.renderedSize(content); }
+    char* renderInto(char* out, std::string_view content) const override { return mLetter.renderInto(out, content); }
+
+private:
+    Letter mLetter;
+    char mPadding[256] = {};
+};
+
+void CheckTemplateReload()
+{
+    DocumentTemplateRegistry registry;
+    const size_t idsBefore = DocumentPool::IdsInUse();
+
+    for(size_t i = 0; i < 1000; ++i)
+    {
+        registry.add("letter", std::make_unique<Letter>("Letter Header v" + std::to_string(i), "Letter Footer"));
+        DocumentHandle document = registry.getPrototype("letter");
+    }
+    CHECK(DocumentPool::IdsInUse() == idsBefore);
+    CHECK(registry.retiredPools() == 0);
+
+    DocumentHandle oldSize = registry.getPrototype("letter");
+    registry.add("letter", std::make_unique<WideLetter>());
+    // No reader is inside a lookup, so the registry lets go of the old pool right away and
+    // only the clone still holds it.
+    CHECK(registry.retiredPools() == 0);
+    CHECK(DocumentPool::IdsInUse() == idsBefore + 1);
+    DocumentHandle newSize = registry.getPrototype("letter");
+    CHECK(newSize && newSize->objectSize() == sizeof(WideLetter));
+    CHECK(oldSize && oldSize->objectSize() == sizeof(Letter));
+
+    oldSize.reset();
+    registry.add("letter", std::make_unique<WideLetter>());
+    CHECK(registry.retiredPools() == 0);
+    // The retired pool's id is free again, only the new pool's id was added.
+    CHECK(DocumentPool::IdsInUse() <= idsBefore + 1);
+}
+
+// Clones handed out before the registry is destroyed stay usable and release their storage
+// into a pool that is still alive.
+void CheckHandleOutlivesRegistry()
+{
+    DocumentHandle letter;
+    DocumentHandle report;
+    {
+        DocumentTemplateRegistry registry;
+        letter = registry.getPrototype("letter");
+        report = registry.getPrototype("report");
+    }
+    CHECK(letter && report);
+    letter->fillContent("Body");
+    CHECK(Printed(*letter.get()).find("Body") != std::string::npos);
+    letter.reset();
+    report.reset();
+}
+
+// Once the pool and the thread's list are warm, cloning a template and releasing the clone
+// never touch the heap. Allocations are only counted in bench_app (see alloc_counter.h), so
+// `make check` runs the checks there as well.
+void CheckSteadyStateAllocations()
+{
+    if(!bench::CountingAllocations())
+    {
+        return;
+    }
+
+    DocumentTemplateRegistry registry;
+    const auto letterId = registry.resolve("letter");
+    std::vector<DocumentHandle> documents(16);
+    auto cloneAndRelease = [&](size_t rounds) {
+        for(size_t i = 0; i < rounds; ++i)
+        {
+            for(auto& document : documents)
+            {
+                document = i % 2 ? registry.getPrototype(letterId) : registry.getPrototype(std::string_view("report"));
+            }
+            for(auto& document : documents)
+            {
+                document.reset();
+            }
+        }
+    };
+
+    cloneAndRelease(4);
+    bench::AllocationCount before = bench::Allocations();
+    cloneAndRelease(1000);
+    CHECK(bench::Allocations().allocations == before.allocations);
+}
+
+// The deep-copy comparator must render exactly like the Letter it is compared with.
+void CheckDeepCopyLetter()
+{
+    Letter letter("Header", "Footer");
+    DeepCopyLetter deep("Header", "Footer");
+    letter.fillContent("Body");
+    deep.fillContent("Body");
+    CHECK(Printed(deep) == Printed(letter));
+
+    const std::vector<std::string> contents{"Dear Ann,", "Dear Bob,"};
+    CHECK(BatchRenderer::Render(deep, contents) == BatchRenderer::Render(letter, contents));
+}
+
+int RunChecks()
+{
+    CheckCopyOnWrite();
+    CheckCrossThreadPool();
+    CheckTemplateReload();
+    CheckHandleOutlivesRegistry();
+    CheckSteadyStateAllocations();
+    CheckDeepCopyLetter();
+    return check::Report("prototype");
+}
@@ -0,0 +1,69 @@
+
+# Optimized build profiles shared by every example.
+#
+# Included at the end of each example's Makefile, which sets beforehand:
+#   PROFILE_SRC        the example's source file
+#   PROFILE_BIN        base name of the binaries, <name>.<profile> is built per profile
+#   PROFILE_CXX        compiler
+#   PROFILE_CXXFLAGS   the example's usual flags (standard, warnings, -pthread)
+#   PROFILE_DEPS       other prerequisites (headers)
+#
+#   make release       -O3 -march=native
+#   make lto           release + link time optimization
+#   make pgo-gen       instrumented release build plus one training run (PGO_TRAINING),
+#                      which records the execution profile in pgo/
+#   make pgo-use       release build optimized with the recorded profile
+#   make trace         release build with trace spans compiled in (tracing/trace.h)
+#   make sanitize      debug build with AddressSanitizer and UndefinedBehaviorSanitizer,
+#                      any report aborts the run
+#
+# PROFILE_EXTRA is added to every compile, e.g. for GCC dump options.
+
+RELEASE_FLAGS = -O3 -march=native
+LTO_FLAGS = $(RELEASE_FLAGS) -flto=auto
+PGO_GEN_FLAGS = $(RELEASE_FLAGS) -fprofile-generate -fprofile-update=atomic
+PGO_USE_FLAGS = $(RELEASE_FLAGS) -fprofile-use -fprofile-correction -Wmissing-profile
+PGO_TRAINING ?= --harness --reps 5 --warmup 1
+TRACE_FLAGS = $(RELEASE_FLAGS) -DTRACE_ENABLED=1
+SANITIZE_FLAGS = -O1 -g -fno-omit-frame-pointer -fsanitize=address,undefined -fno-sanitize-recover=all
+PROFILE_EXTRA ?=
+
+# The profile is looked up by object file name, so both PGO steps compile to the same object.
+PGO_DIR = pgo
+PGO_OBJECT = $(PGO_DIR)/$(PROFILE_SRC:.cpp=.o)
+PGO_DATA = $(PGO_DIR)/$(PROFILE_SRC:.cpp=.gcda)
+
+PROFILE_OUTPUTS = $(PROFILE_BIN).release $(PROFILE_BIN).lto $(PROFILE_BIN).pgo-gen $(PROFILE_BIN).pgo-use $(PROFILE_BIN).trace $(PROFILE_BIN).sanitize $(PGO_DIR)
+
+.PHONY: release lto pgo-gen pgo-use trace sanitize
+release: $(PROFILE_BIN).release
+lto: $(PROFILE_BIN).lto
+trace: $(PROFILE_BIN).trace
+sanitize: $(PROFILE_BIN).sanitize
+pgo-gen: $(PGO_DATA)
+pgo-use: $(PROFILE_BIN).pgo-use
+
+$(PROFILE_BIN).release: $(PROFILE_SRC) $(PROFILE_DEPS)
+	$(PROFILE_CXX) $(PROFILE_CXXFLAGS) $(RELEASE_FLAGS) $(PROFILE_EXTRA) $(PROFILE_SRC) -o $@
+
+$(PROFILE_BIN).lto: $(PROFILE_SRC) $(PROFILE_DEPS)
+	$(PROFILE_CXX) $(PROFILE_CXXFLAGS) $(LTO_FLAGS) $(PROFILE_EXTRA) $(PROFILE_SRC) -o $@
+
+$(PROFILE_BIN).trace: $(PROFILE_SRC) $(PROFILE_DEPS)
+	$(PROFILE_CXX) $(PROFILE_CXXFLAGS) $(TRACE_FLAGS) $(PROFILE_EXTRA) $(PROFILE_SRC) -o $@
+
+$(PROFILE_BIN).sanitize: $(PROFILE_SRC) $(PROFILE_DEPS)
+	$(PROFILE_CXX) $(PROFILE_CXXFLAGS) $(SANITIZE_FLAGS) $(PROFILE_EXTRA) $(PROFILE_SRC) -o $@
+
+$(PROFILE_BIN).pgo-gen: $(PROFILE_SRC) $(PROFILE_DEPS)
+	@mkdir -p $(PGO_DIR)
+	@rm -f $(PGO_DATA)
+	$(PROFILE_CXX) $(PROFILE_CXXFLAGS) $(PGO_GEN_FLAGS) $(PROFILE_EXTRA) -c $(PROFILE_SRC) -o $(PGO_OBJECT)
+	$(PROFILE_CXX) $(PROFILE_CXXFLAGS) $(PGO_GEN_FLAGS) $(PGO_OBJECT) -o $@
+
+$(PGO_DATA): $(PROFILE_BIN).pgo-gen
+	./$(PROFILE_BIN).pgo-gen $(PGO_TRAINING) > /dev/null
+
+$(PROFILE_BIN).pgo-use: $(PGO_DATA)
+	$(PROFILE_CXX) $(PROFILE_CXXFLAGS) $(PGO_USE_FLAGS) $(PROFILE_EXTRA) -c $(PROFILE_SRC) -o $(PGO_OBJECT)
+	$(PROFILE_CXX) $(PROFILE_CXXFLAGS) $(RELEASE_FLAGS) $(PGO_OBJECT) -o $@
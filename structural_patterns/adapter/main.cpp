@@ -1,7 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "../../benchmarks/bench.h"
+
 // Adapter (aka Wrapper)
 //
 // The Adapter design pattern is a structural pattern used to make two incompatible
@@ -10,41 +22,185 @@
 // In the example below, TextShape class is adapter for ExternalLibraryTextDrawing.
 // ExternalLibraryTextDrawing is class from external library that doesn't implements 
 // the Draw API that is mandatory for all Shape classes.
+//
+// SceneRenderer keeps shapes grouped by their concrete type and draws every group with
+// one non-virtual DrawAll() call, so the adapted TextShape can hand a whole batch to the
+// external library at once.
+//
+// AsyncTextShape adapts a slow, non thread safe library differently: every call is queued
+// to one worker thread that owns the library instance, and callers get a ticket (a future) back.
+//
+// RetainedScene draws in retained mode: the shapes record their draw calls once into a
+// DrawCommandList, and every frame replays that list without a single virtual call until
+// a shape is added or removed.
+
+//! \brief: Compares the per-shape virtual loop with SceneRenderer, RetainedScene and the
+//!         async adapter on the shared harness. Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
 
 class ExternalLibraryTextDrawing
 {
 public:
     void DrawText()
     {
-        std::cout << "External library API is drawing text" << std::endl;
+        std::cout << "External library API is drawing text\n";
     }
+
+    // Batch entry point of the library: one call for `count` texts.
+    void DrawTextBatch(size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            std::cout << "External library API is drawing text\n";
+        }
+        std::cout.flush();
+    }
+};
+
+//! \brief: Contiguous, non-owning view of shapes of a single concrete type.
+template<class T>
+struct ShapeSpan
+{
+    const T* data;
+    size_t size;
+
+    const T* begin() const { return data; }
+    const T* end() const { return data + size; }
+};
+
+class Shape;
+
+enum class DrawOp : uint32_t
+{
+    Circle,
+    Line,
+    Text,
+    Shape       // any other shape, replayed through its virtual Draw()
+};
+
+// One recorded draw call. Consecutive calls of the same kind share a record.
+struct DrawCommand
+{
+    DrawOp op;
+    uint32_t arg;   // number of shapes, or for DrawOp::Shape the index of the shape
+};
+
+// Draw calls recorded by the shapes of a scene, in drawing order, as one contiguous array
+// of plain records.
+class DrawCommandList
+{
+public:
+    void DrawCircle() { Append(DrawOp::Circle); }
+    void DrawLine() { Append(DrawOp::Line); }
+    void DrawText() { Append(DrawOp::Text); }
+
+    //! \brief: Records a shape that has no command of its own. It must outlive the list.
+    void DrawShape(Shape& shape)
+    {
+        mCommands.push_back(DrawCommand{DrawOp::Shape, static_cast<uint32_t>(mShapes.size())});
+        mShapes.push_back(&shape);
+    }
+
+    //! \brief: Draws what was recorded, text goes to `textDrawer` in batches.
+    void Replay(ExternalLibraryTextDrawing& textDrawer) const;
+
+    void Clear()
+    {
+        mCommands.clear();
+        mShapes.clear();
+    }
+
+    size_t size() const { return mCommands.size(); }
+
+private:
+    void Append(DrawOp op)
+    {
+        if(!mCommands.empty() && mCommands.back().op == op)
+        {
+            ++mCommands.back().arg;
+            return;
+        }
+        mCommands.push_back(DrawCommand{op, 1});
+    }
+
+    std::vector<DrawCommand> mCommands;
+    std::vector<Shape*> mShapes;
 };
 
 class Shape
 {
 public:
+    //! \brief: Draws the shape without flushing; whoever draws the frame flushes once.
     virtual void Draw() = 0;
+    virtual ~Shape() = default;
+
+    //! \brief: Records what Draw() would do. By default the shape itself is recorded and
+    //!         replaying calls Draw().
+    virtual void Record(DrawCommandList& commands)
+    {
+        commands.DrawShape(*this);
+    }
 };
 
-class CircleShape : public Shape
+class CircleShape final : public Shape
 {
 public:
     void Draw() override
     {
-        std::cout << "Drawing circle" << std::endl;
+        std::cout << "Drawing circle\n";
+    }
+
+    void Record(DrawCommandList& commands) override
+    {
+        commands.DrawCircle();
+    }
+
+    static void DrawAll(ShapeSpan<CircleShape> circles)
+    {
+        DrawRun(circles.size);
+        std::cout.flush();
+    }
+
+    //! \brief: Draws `count` circles without flushing.
+    static void DrawRun(size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            std::cout << "Drawing circle\n";
+        }
     }
 };
 
-class LineShape : public Shape
+class LineShape final : public Shape
 {
 public:
     void Draw() override
     {
-        std::cout << "Drawing line" << std::endl;
+        std::cout << "Drawing line\n";
+    }
+
+    void Record(DrawCommandList& commands) override
+    {
+        commands.DrawLine();
+    }
+
+    static void DrawAll(ShapeSpan<LineShape> lines)
+    {
+        DrawRun(lines.size);
+        std::cout.flush();
+    }
+
+    //! \brief: Draws `count` lines without flushing.
+    static void DrawRun(size_t count)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            std::cout << "Drawing line\n";
+        }
     }
 };
 
-class TextShape : public Shape
+class TextShape final : public Shape
 {
 private:
     ExternalLibraryTextDrawing mTextDrawer;
@@ -54,10 +210,381 @@ public:
     {
         mTextDrawer.DrawText();
     }
+
+    void Record(DrawCommandList& commands) override
+    {
+        commands.DrawText();
+    }
+
+    // Bulk adapter path: the whole batch is a single call into the external library.
+    static void DrawAll(ShapeSpan<TextShape> texts)
+    {
+        if(texts.size == 0)
+        {
+            return;
+        }
+        ExternalLibraryTextDrawing textDrawer;
+        textDrawer.DrawTextBatch(texts.size);
+    }
+};
+
+void DrawCommandList::Replay(ExternalLibraryTextDrawing& textDrawer) const
+{
+    for(const DrawCommand& command : mCommands)
+    {
+        switch(command.op)
+        {
+            case DrawOp::Circle:
+                CircleShape::DrawRun(command.arg);
+                break;
+            case DrawOp::Line:
+                LineShape::DrawRun(command.arg);
+                break;
+            case DrawOp::Text:
+                textDrawer.DrawTextBatch(command.arg);
+                break;
+            case DrawOp::Shape:
+                mShapes[command.arg]->Draw();
+                break;
+        }
+    }
+    std::cout.flush();
+}
+
+// Owns a single instance of a non thread safe text library on a dedicated worker thread.
+//
+// Callers enqueue draw requests into a bounded lock-free ring (multi producer, single
+// consumer) and receive a Ticket, a future that becomes ready once the request was drawn.
+// The worker drains up to `maxBatch` requests at a time and draws them with one
+// DrawTextBatch() call. A full ring is reported back to the caller instead of blocking it
+// (back-pressure). Submitting neither allocates nor locks: a request is its slot in the
+// ring, and since the worker draws in submission order one completed-position counter
+// completes every ticket.
+template<class Library>
+class AsyncLibraryWorker
+{
+public:
+    // Future of one queued request.
+    class Ticket
+    {
+    public:
+        Ticket(const AsyncLibraryWorker* worker, size_t position) : mWorker(worker), mPosition(position) {}
+
+        bool ready() const { return mWorker->mCompleted.load(std::memory_order_acquire) > mPosition; }
+
+        //! \brief: Waits until the request was drawn, yielding and then sleeping.
+        void wait() const
+        {
+            for(int rounds = 0; !ready(); ++rounds)
+            {
+                Backoff(rounds);
+            }
+        }
+
+    private:
+        const AsyncLibraryWorker* mWorker;
+        size_t mPosition;
+    };
+
+    explicit AsyncLibraryWorker(size_t capacity = 1024, size_t maxBatch = 64)
+        : mSlots(RoundUpToPowerOfTwo(capacity)), mMask(mSlots.size() - 1), mMaxBatch(maxBatch)
+    {
+        for(size_t i = 0; i < mSlots.size(); ++i)
+        {
+            mSlots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mWorker = std::thread([this] { Run(); });
+    }
+
+    AsyncLibraryWorker(const AsyncLibraryWorker&) = delete;
+    AsyncLibraryWorker& operator=(const AsyncLibraryWorker&) = delete;
+
+    //! \brief: Drains the remaining requests and joins the worker, which destroys the library.
+    ~AsyncLibraryWorker()
+    {
+        mStopping.store(true, std::memory_order_release);
+        mWorker.join();
+    }
+
+    //! \returns: ticket of the queued request, or nothing when the ring is full.
+    std::optional<Ticket> TrySubmit()
+    {
+        size_t position = mTail.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Slot& slot = mSlots[position & mMask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if(sequence == position)
+            {
+                if(mTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return Ticket(this, position);
+                }
+            }
+            else if(sequence < position)
+            {
+                mRejected.fetch_add(1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+            else
+            {
+                position = mTail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    uint64_t drawn() const { return mDrawn.load(std::memory_order_relaxed); }
+    uint64_t batches() const { return mBatches.load(std::memory_order_relaxed); }
+    uint64_t rejected() const { return mRejected.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<size_t> sequence;
+    };
+
+    static size_t RoundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 2;
+        while(result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    //! \brief: One round of waiting: yields at first, then sleeps so an idle wait costs no CPU.
+    static void Backoff(int rounds)
+    {
+        if(rounds < 64)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    // The library is created, used and destroyed on this thread only.
+    void Run()
+    {
+        Library library;
+        size_t head = 0;
+        int idleRounds = 0;
+        for(;;)
+        {
+            size_t count = 0;
+            while(count < mMaxBatch &&
+                  mSlots[(head + count) & mMask].sequence.load(std::memory_order_acquire) == head + count + 1)
+            {
+                ++count;
+            }
+
+            if(count == 0)
+            {
+                if(mStopping.load(std::memory_order_acquire) &&
+                   mTail.load(std::memory_order_acquire) == head)
+                {
+                    return;
+                }
+                Backoff(idleRounds++);
+                continue;
+            }
+            idleRounds = 0;
+
+            library.DrawTextBatch(count);
+
+            mCompleted.store(head + count, std::memory_order_release);
+            for(size_t i = 0; i < count; ++i)
+            {
+                mSlots[(head + i) & mMask].sequence.store(head + i + mSlots.size(), std::memory_order_release);
+            }
+            head += count;
+            mDrawn.fetch_add(count, std::memory_order_relaxed);
+            mBatches.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<Slot> mSlots;
+    const size_t mMask;
+    const size_t mMaxBatch;
+
+    alignas(64) std::atomic<size_t> mTail{0};
+    alignas(64) std::atomic<size_t> mCompleted{0};     // requests before this position are drawn
+    alignas(64) std::atomic<bool> mStopping{false};
+    std::atomic<uint64_t> mDrawn{0};
+    std::atomic<uint64_t> mBatches{0};
+    std::atomic<uint64_t> mRejected{0};
+
+    std::thread mWorker;
+};
+
+// Adapter that never calls the external library on the caller's thread.
+template<class Library>
+class AsyncTextShape final : public Shape
+{
+public:
+    using Ticket = typename AsyncLibraryWorker<Library>::Ticket;
+
+    explicit AsyncTextShape(AsyncLibraryWorker<Library>& worker) : mWorker(worker) {}
+
+    //! \brief: Queues the text without waiting. While the worker is saturated the text is
+    //!         deferred, and queued by a later Draw() or by EndFrame(); it is never lost.
+    void Draw() override
+    {
+        SubmitDeferred();
+        if(mDeferred > 0 || !Submit())
+        {
+            ++mDeferred;
+            ++mDeferredTotal;
+        }
+    }
+
+    //! \brief: Frame boundary: queues the deferred texts, waiting for ring space if needed,
+    //!         and returns once every text this shape drew is on screen.
+    void EndFrame()
+    {
+        SubmitDeferred();
+        while(mDeferred > 0)
+        {
+            std::this_thread::yield();
+            SubmitDeferred();
+        }
+        if(mLast)
+        {
+            mLast->wait();
+            mLast.reset();
+        }
+    }
+
+    //! \returns: ticket of the queued draw, or nothing under back-pressure.
+    std::optional<Ticket> DrawAsync()
+    {
+        return mWorker.TrySubmit();
+    }
+
+    //! \returns: draws that found the ring full and had to wait for a later submit.
+    uint64_t deferred() const { return mDeferredTotal; }
+
+private:
+    bool Submit()
+    {
+        std::optional<Ticket> ticket = mWorker.TrySubmit();
+        if(ticket)
+        {
+            mLast = ticket;
+        }
+        return ticket.has_value();
+    }
+
+    void SubmitDeferred()
+    {
+        while(mDeferred > 0 && Submit())
+        {
+            --mDeferred;
+        }
+    }
+
+    AsyncLibraryWorker<Library>& mWorker;
+    std::optional<Ticket> mLast;
+    uint64_t mDeferred = 0;
+    uint64_t mDeferredTotal = 0;
+};
+
+// Stores shapes by value, one contiguous array per concrete type.
+class SceneRenderer
+{
+public:
+    void Add(const CircleShape& circle) { mCircles.push_back(circle); }
+    void Add(const LineShape& line) { mLines.push_back(line); }
+    void Add(const TextShape& text) { mTexts.push_back(text); }
+
+    size_t size() const { return mCircles.size() + mLines.size() + mTexts.size(); }
+
+    void DrawAll() const
+    {
+        CircleShape::DrawAll(Span(mCircles));
+        LineShape::DrawAll(Span(mLines));
+        TextShape::DrawAll(Span(mTexts));
+    }
+
+private:
+    template<class T>
+    static ShapeSpan<T> Span(const std::vector<T>& shapes)
+    {
+        return ShapeSpan<T>{shapes.data(), shapes.size()};
+    }
+
+    std::vector<CircleShape> mCircles;
+    std::vector<LineShape> mLines;
+    std::vector<TextShape> mTexts;
+};
+
+// Draws its shapes in their insertion order. The first frame, and the first one after an
+// Add or Remove, records the shapes into a command list; every other frame only replays it.
+// Shapes are immutable once added, anything that changes how one draws must re-add it.
+class RetainedScene
+{
+public:
+    void Add(std::shared_ptr<Shape> shape)
+    {
+        mShapes.push_back(std::move(shape));
+        mDirty = true;
+    }
+
+    void Remove(const Shape* shape)
+    {
+        auto found = std::find_if(mShapes.begin(), mShapes.end(), [&](const auto& owned) { return owned.get() == shape; });
+        if(found != mShapes.end())
+        {
+            mShapes.erase(found);
+            mDirty = true;
+        }
+    }
+
+    void Draw()
+    {
+        if(mDirty)
+        {
+            Record();
+        }
+        mCommands.Replay(mTextDrawer);
+    }
+
+    //! \brief: Records the shapes now instead of on the next Draw().
+    void Record()
+    {
+        mCommands.Clear();
+        for(auto& shape : mShapes)
+        {
+            shape->Record(mCommands);
+        }
+        mDirty = false;
+        ++mRecordings;
+    }
+
+    size_t size() const { return mShapes.size(); }
+    size_t commands() const { return mCommands.size(); }
+    uint64_t recordings() const { return mRecordings; }
+
+private:
+    std::vector<std::shared_ptr<Shape>> mShapes;
+    DrawCommandList mCommands;
+    ExternalLibraryTextDrawing mTextDrawer;
+    bool mDirty = false;
+    uint64_t mRecordings = 0;
 };
 
-int main()
+int main(int argc, char* argv[])
 {
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+
     using ShapePtr = std::shared_ptr<Shape>;
     std::vector<ShapePtr> shapes;
 
@@ -65,10 +592,225 @@ int main()
     shapes.push_back(std::make_shared<LineShape>());
     shapes.push_back(std::make_shared<TextShape>());
 
-    for(auto shape : shapes)
+    for(const auto& shape : shapes)
     {
         shape->Draw();
     }
 
+    std::cout << std::endl;
+
+    SceneRenderer scene;
+    scene.Add(TextShape{});
+    scene.Add(CircleShape{});
+    scene.Add(LineShape{});
+    scene.Add(TextShape{});
+    scene.DrawAll();
+
+    std::cout << std::endl;
+
+    RetainedScene retained;
+    for(const auto& shape : shapes)
+    {
+        retained.Add(shape);
+    }
+    retained.Draw();
+    retained.Draw();
+    std::cout << retained.size() << " shapes, " << retained.commands() << " commands, recorded "
+              << retained.recordings() << " time(s) for 2 frames" << std::endl;
+
+    std::cout << std::endl;
+
+    AsyncLibraryWorker<ExternalLibraryTextDrawing> textWorker;
+    AsyncTextShape<ExternalLibraryTextDrawing> asyncText(textWorker);
+    asyncText.Draw();
+    asyncText.Draw();
+    asyncText.EndFrame();
+
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+// Stand-in for a slow third party library: fixed cost per call plus a small cost per text.
+class SlowTextLibrary
+{
+public:
+    void DrawText()
+    {
+        Spin(std::chrono::microseconds(50));
+    }
+
+    void DrawTextBatch(size_t count)
+    {
+        Spin(std::chrono::microseconds(50) + std::chrono::microseconds(1) * count);
+    }
+
+private:
+    static void Spin(std::chrono::nanoseconds duration)
+    {
+        auto until = std::chrono::steady_clock::now() + duration;
+        while(std::chrono::steady_clock::now() < until)
+        {
+        }
+    }
+};
+
+//! \brief: The slow library called directly against the async adapter, which batches calls
+//!         on its worker. The async case runs from the first submit until every draw is done.
+void BenchmarkAsyncAdapter(bench::Harness& harness)
+{
+    const size_t draws = 200;
+    using Clock = std::chrono::steady_clock;
+
+    SlowTextLibrary direct;
+    harness.run("slow library, synchronous draw", draws, [&] {
+        for(size_t i = 0; i < draws; ++i)
+        {
+            direct.DrawText();
+        }
+    });
+
+    AsyncLibraryWorker<SlowTextLibrary> worker(4096, 256);
+    std::vector<AsyncLibraryWorker<SlowTextLibrary>::Ticket> pending;
+    pending.reserve(draws);
+    std::chrono::nanoseconds callerTime{0};
+    size_t submits = 0;
+    harness.run("slow library, async draw, submit to ready", draws, [&] {
+        pending.clear();
+        while(pending.size() < draws)
+        {
+            auto callStart = Clock::now();
+            auto submitted = worker.TrySubmit();
+            callerTime += Clock::now() - callStart;
+            ++submits;
+            if(submitted)
+            {
+                pending.push_back(std::move(*submitted));
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        for(auto& ticket : pending)
+        {
+            ticket.wait();
+        }
+    });
+    harness.note("caller latency %.0f ns per submit, %llu batches, %llu rejected submits",
+                 callerTime.count() / static_cast<double>(std::max<size_t>(submits, 1)),
+                 static_cast<unsigned long long>(worker.batches()), static_cast<unsigned long long>(worker.rejected()));
+
+    // A frame of async text shapes through a ring too small for it: the draws that do not
+    // fit are deferred to EndFrame(), which waits until the whole frame is drawn.
+    AsyncLibraryWorker<SlowTextLibrary> smallRing(64, 64);
+    AsyncTextShape<SlowTextLibrary> text(smallRing);
+    uint64_t drawnBefore = smallRing.drawn();
+    size_t frames = 0;
+    harness.run("slow library, async shape frame, 64 slots", draws, [&] {
+        for(size_t i = 0; i < draws; ++i)
+        {
+            text.Draw();
+        }
+        text.EndFrame();
+        ++frames;
+    });
+    harness.note("%.0f of %zu draws per frame deferred, %.0f drawn",
+                 text.deferred() / static_cast<double>(std::max<size_t>(frames, 1)), draws,
+                 (smallRing.drawn() - drawnBefore) / static_cast<double>(std::max<size_t>(frames, 1)));
+}
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("adapter", argc, argv);
+    bench::MuteStdout mute;
+
+    // 10k shapes per frame by default, `--scale 100` draws the 1M shapes of a large scene.
+    const size_t shapeCount = harness.scaled(10000);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> pickType(0, 2);
+    std::vector<std::shared_ptr<Shape>> shapes;
+    SceneRenderer scene;
+    for(size_t i = 0; i < shapeCount; ++i)
+    {
+        switch(pickType(rng))
+        {
+            case 0:  shapes.push_back(std::make_shared<CircleShape>()); scene.Add(CircleShape{}); break;
+            case 1:  shapes.push_back(std::make_shared<LineShape>());   scene.Add(LineShape{});   break;
+            default: shapes.push_back(std::make_shared<TextShape>());   scene.Add(TextShape{});   break;
+        }
+    }
+
+    harness.run("draw shape, virtual loop", shapeCount, [&] {
+        for(const auto& shape : shapes)
+        {
+            shape->Draw();
+        }
+        std::cout.flush();
+    });
+    // Copying the shared_ptr costs two atomic reference count updates per shape.
+    harness.run("draw shape, virtual loop, by value", shapeCount, [&] {
+        for(auto shape : shapes)
+        {
+            shape->Draw();
+        }
+        std::cout.flush();
+    });
+    harness.run("draw shape, batched scene", shapeCount, [&] { scene.DrawAll(); });
+
+    // Immediate mode against replaying the recorded command list, and what re-recording costs.
+    // Both flush once per frame.
+    std::pair<size_t, const char*> sizes[] = {{100000, "100k"}, {1000000, "1M"}};
+    for(auto [count, label] : sizes)
+    {
+        std::vector<std::shared_ptr<Shape>> frameShapes;
+        RetainedScene retained;
+        for(size_t i = 0; i < count; ++i)
+        {
+            switch(pickType(rng))
+            {
+                case 0:  frameShapes.push_back(std::make_shared<CircleShape>()); break;
+                case 1:  frameShapes.push_back(std::make_shared<LineShape>());   break;
+                default: frameShapes.push_back(std::make_shared<TextShape>());   break;
+            }
+            retained.Add(frameShapes.back());
+        }
+        retained.Record();
+
+        std::string suffix = std::string(", ") + label + " shapes";
+        harness.run("immediate frame" + suffix, count, [&] {
+            for(const auto& shape : frameShapes)
+            {
+                shape->Draw();
+            }
+            std::cout.flush();
+        });
+        harness.run("replayed frame" + suffix, count, [&] { retained.Draw(); });
+        harness.run("record frame" + suffix, count, [&] { retained.Record(); });
+    }
+
+    const size_t draws = 1000;
+    AsyncLibraryWorker<ExternalLibraryTextDrawing> worker;
+    std::vector<AsyncLibraryWorker<ExternalLibraryTextDrawing>::Ticket> pending;
+    pending.reserve(draws);
+    harness.run("async text draw, submit to ready", draws, [&] {
+        pending.clear();
+        while(pending.size() < draws)
+        {
+            if(auto submitted = worker.TrySubmit())
+            {
+                pending.push_back(std::move(*submitted));
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        for(auto& ticket : pending)
+        {
+            ticket.wait();
+        }
+    });
+
+    BenchmarkAsyncAdapter(harness);
+}
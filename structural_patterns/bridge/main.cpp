@@ -5,6 +5,8 @@
 #include <iomanip> //std::put_time
 #include <sstream>
 
+#include "../../benchmarks/bench.h"
+
 // The Bridge design pattern (aka Handle, Body)
 //
 // The Bridge design pattern is a structural design pattern that is used 
@@ -14,13 +16,16 @@
 // to evolve independently, making it easier to add new abstractions and 
 // implementations without affecting existing code.
 
+//! \brief: Times the example's hot paths with the shared harness. Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
+
 class LoggerBackend
 {
 public:
     virtual void ProcessLogLine(std::string line) = 0;
 };
 
-class UdpLoggerBackend : public LoggerBackend
+class UdpLoggerBackend final : public LoggerBackend
 {
 public:
     void ProcessLogLine(std::string line) override
@@ -29,7 +34,7 @@ public:
     }
 };
 
-class FileLoggerBackend : public LoggerBackend
+class FileLoggerBackend final : public LoggerBackend
 {
 public:
     void ProcessLogLine(std::string line) override
@@ -56,8 +61,14 @@ public:
     }
 };
 
-int main()
+int main(int argc, char* argv[])
 {
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+
     // We have different hierarchies for the logger and the logger backend.
     // We can add another logger backend (Console for example), but the Logger class
     // hierarchy will not be effected.
@@ -68,4 +79,31 @@ int main()
     logger.LogLine("Hello World!");
 
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("bridge", argc, argv);
+    bench::MuteStdout mute;
+
+    const size_t lines = 1000;
+    std::unique_ptr<LoggerBackend> udpBackend = std::make_unique<UdpLoggerBackend>();
+    std::unique_ptr<LoggerBackend> fileBackend = std::make_unique<FileLoggerBackend>();
+    Logger udpLogger(udpBackend);
+    Logger fileLogger(fileBackend);
+
+    harness.run("log line, udp backend", lines, [&] {
+        for(size_t i = 0; i < lines; ++i)
+        {
+            udpLogger.LogLine("request served in 12 ms");
+        }
+    });
+    harness.run("log line, file backend", lines, [&] {
+        for(size_t i = 0; i < lines; ++i)
+        {
+            fileLogger.LogLine("request served in 12 ms");
+        }
+    });
+}
@@ -1,6 +1,27 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <vector>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../benchmarks/bench.h"
+#include "../../tests/check.h"
 
 // Composite design pattern
 //
@@ -12,40 +33,177 @@
 //
 // Its important that both leafs and the composites have uniform API for this pattern to work.
 // In our example the API is Draw().
+//
+// A tree can also be saved as a binary snapshot (see SnapshotWriter) and drawn straight from
+// the mapped file (see Snapshot), so large UIs start without constructing any component.
+//
+//     ./app --save gui.snap        saves the demo panel
+//     ./app --load gui.snap        validates the file and draws it
+
+//! \brief: Times the example's hot paths with the shared harness. Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
+
+//! \brief: Runs the example's self-checks. Run with `./app --check`.
+int RunChecks();
+
+class SnapshotWriter;
 
 class GuiComponent
 {
 public:
     virtual void Draw() = 0;
+
+    //! \brief: Stores the component, and its children, in `writer`. Use SnapshotWriter::Add,
+    //!         which stores every component once.
+    //! \returns: index of the component's node.
+    virtual uint32_t Save(SnapshotWriter& writer) const = 0;
+};
+
+// Binary snapshot layout
+//
+// Everything is addressed by offsets and indices, never pointers, so a snapshot is valid
+// wherever it is mapped. Integers are in host byte order; a file from a host with the other
+// byte order fails the version check.
+//
+//     SnapshotHeader
+//     SnapshotNode[nodeCount]      children are stored before the panels that hold them
+//     uint32_t[childCount]         node indices, every panel owns one contiguous range
+
+enum class NodeKind : uint32_t
+{
+    Button = 1,
+    Line = 2,
+    Panel = 3
+};
+
+constexpr char kSnapshotMagic[8] = {'G', 'U', 'I', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t kSnapshotVersion = 1;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t root;
+    uint32_t nodeCount;
+    uint32_t childCount;
+    uint64_t nodesOffset;       // from the start of the snapshot
+    uint64_t childrenOffset;
+    uint64_t size;              // of the whole snapshot
+};
+
+struct SnapshotNode
+{
+    NodeKind kind;
+    uint32_t firstChild;        // index into the child table
+    uint32_t childCount;
+};
+
+class SnapshotWriter
+{
+public:
+    //! \returns: node index of `component`, saving it the first time it is seen. Components
+    //!           shared by several panels are stored once.
+    uint32_t Add(const GuiComponent& component)
+    {
+        auto found = mSaved.find(&component);
+        if(found != mSaved.end())
+        {
+            return found->second;
+        }
+        uint32_t node = component.Save(*this);
+        mSaved.emplace(&component, node);
+        return node;
+    }
+
+    //! \brief: Appends a node, its children must already be stored.
+    uint32_t AddNode(NodeKind kind, const std::vector<uint32_t>& children = {})
+    {
+        mNodes.push_back(SnapshotNode{kind, static_cast<uint32_t>(mChildren.size()), static_cast<uint32_t>(children.size())});
+        mChildren.insert(mChildren.end(), children.begin(), children.end());
+        return static_cast<uint32_t>(mNodes.size() - 1);
+    }
+
+    //! \returns: the snapshot of every stored node, drawn from `root`.
+    std::vector<uint8_t> Serialize(uint32_t root) const
+    {
+        SnapshotHeader header{};
+        std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+        header.version = kSnapshotVersion;
+        header.root = root;
+        header.nodeCount = static_cast<uint32_t>(mNodes.size());
+        header.childCount = static_cast<uint32_t>(mChildren.size());
+        header.nodesOffset = sizeof(SnapshotHeader);
+        header.childrenOffset = header.nodesOffset + mNodes.size() * sizeof(SnapshotNode);
+        header.size = header.childrenOffset + mChildren.size() * sizeof(uint32_t);
+
+        std::vector<uint8_t> bytes(header.size);
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        std::memcpy(bytes.data() + header.nodesOffset, mNodes.data(), mNodes.size() * sizeof(SnapshotNode));
+        std::memcpy(bytes.data() + header.childrenOffset, mChildren.data(), mChildren.size() * sizeof(uint32_t));
+        return bytes;
+    }
+
+    //! \brief: Saves `root` and everything below it to `path`. Throws std::system_error on failure.
+    void Write(const std::string& path, const GuiComponent& root)
+    {
+        std::vector<uint8_t> bytes = Serialize(Add(root));
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if(!out)
+        {
+            throw std::system_error(errno, std::generic_category(), "write " + path);
+        }
+    }
+
+private:
+    std::unordered_map<const GuiComponent*, uint32_t> mSaved;
+    std::vector<SnapshotNode> mNodes;
+    std::vector<uint32_t> mChildren;
 };
 
 // Leaf component
-class Button : public GuiComponent
+class Button final : public GuiComponent
 {
 public:
+    static constexpr const char* kDrawText = "Button::Draw()";
+
     void Draw() override
     {
-        std::cout << "Button::Draw()" << std::endl;
+        std::cout << kDrawText << std::endl;
+    }
+
+    uint32_t Save(SnapshotWriter& writer) const override
+    {
+        return writer.AddNode(NodeKind::Button);
     }
 };
 
 // Leaf component
-class Line : public GuiComponent
+class Line final : public GuiComponent
 {
 public:
+    static constexpr const char* kDrawText = "Line::Draw()";
+
     void Draw() override
     {
-        std::cout << "Line::Draw()" << std::endl;
+        std::cout << kDrawText << std::endl;
+    }
+
+    uint32_t Save(SnapshotWriter& writer) const override
+    {
+        return writer.AddNode(NodeKind::Line);
     }
 };
 
 // Composite component
-class Panel : public GuiComponent
+class Panel final : public GuiComponent
 {
 public:
+    static constexpr const char* kDrawText = "Line::Panel()";
+
     void Draw() override
     {
-        std::cout << "Line::Panel()" << std::endl;
+        std::cout << kDrawText << std::endl;
 
         for(auto& component : mComponents)
         {
@@ -55,7 +213,18 @@ public:
 
     void Add(std::shared_ptr<GuiComponent> leafComponent)
     {
-        mComponents.push_back(leafComponent);
+        mComponents.push_back(std::move(leafComponent));
+    }
+
+    uint32_t Save(SnapshotWriter& writer) const override
+    {
+        std::vector<uint32_t> children;
+        children.reserve(mComponents.size());
+        for(auto& component : mComponents)
+        {
+            children.push_back(writer.Add(*component));
+        }
+        return writer.AddNode(NodeKind::Panel, children);
     }
 
 private: 
@@ -63,8 +232,235 @@ private:
 
 };
 
-int main()
+// A snapshot mapped read-only from a file and drawn in place.
+class Snapshot
+{
+public:
+    enum class Check
+    {
+        Full,       // untrusted files: every node and child reference is checked
+        Header      // files written by this process: only the header and table bounds
+    };
+
+    // A panel may be shared, so a small file can draw far more nodes than it stores: 64
+    // panels that each hold the previous one twice draw 2^64 nodes. Full validation rejects
+    // snapshots that would draw more than this.
+    static constexpr uint64_t kMaxDrawnNodes = uint64_t(1) << 26;
+
+    //! \brief: Maps the snapshot at `path`. Throws std::system_error if it cannot be read and
+    //!         std::runtime_error if it is not a valid snapshot.
+    explicit Snapshot(const std::string& path, Check check = Check::Full)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        struct stat info{};
+        void* mapping = MAP_FAILED;
+        if(::fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        int error = errno;
+        ::close(fd);
+        if(info.st_size == 0)
+        {
+            throw std::runtime_error(path + ": empty snapshot");
+        }
+        if(mapping == MAP_FAILED)
+        {
+            throw std::system_error(error, std::generic_category(), "mmap " + path);
+        }
+        mMapping = static_cast<const uint8_t*>(mapping);
+        mMappingSize = static_cast<size_t>(info.st_size);
+
+        if(const char* problem = Validate(mMapping, mMappingSize, check))
+        {
+            ::munmap(mapping, mMappingSize);
+            throw std::runtime_error(path + ": " + problem);
+        }
+        std::memcpy(&mHeader, mMapping, sizeof(mHeader));
+        mNodes = reinterpret_cast<const SnapshotNode*>(mMapping + mHeader.nodesOffset);
+        mChildren = reinterpret_cast<const uint32_t*>(mMapping + mHeader.childrenOffset);
+    }
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    ~Snapshot()
+    {
+        ::munmap(const_cast<uint8_t*>(mMapping), mMappingSize);
+    }
+
+    //! \brief: Checks that `size` bytes at `data` hold a snapshot that is safe to draw: all
+    //!         tables are in bounds and aligned, node kinds are known, child references are in
+    //!         range and point to earlier nodes, so the tree has no cycles, and drawing it
+    //!         visits at most kMaxDrawnNodes nodes.
+    //! \returns: nullptr if it is valid, otherwise what is wrong with it.
+    static const char* Validate(const uint8_t* data, size_t size, Check check = Check::Full)
+    {
+        SnapshotHeader header;
+        if(size < sizeof(header))
+        {
+            return "smaller than the header";
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if(std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0)
+        {
+            return "not a snapshot";
+        }
+        if(header.version != kSnapshotVersion)
+        {
+            return "unsupported version or byte order";
+        }
+        if(header.size != size)
+        {
+            return "size does not match the header";
+        }
+        if(!TableFits(data, size, header.nodesOffset, header.nodeCount, sizeof(SnapshotNode), alignof(SnapshotNode)))
+        {
+            return "node table out of bounds";
+        }
+        if(!TableFits(data, size, header.childrenOffset, header.childCount, sizeof(uint32_t), alignof(uint32_t)))
+        {
+            return "child table out of bounds";
+        }
+        if(header.root >= header.nodeCount)
+        {
+            return "root out of range";
+        }
+        if(check == Check::Header)
+        {
+            return nullptr;
+        }
+
+        const auto* nodes = reinterpret_cast<const SnapshotNode*>(data + header.nodesOffset);
+        const auto* children = reinterpret_cast<const uint32_t*>(data + header.childrenOffset);
+        // Nodes drawn from each node, children included. Children come first, so one pass in
+        // index order is enough. Saturates just above the limit.
+        std::vector<uint64_t> drawn(header.nodeCount, 1);
+        for(uint32_t i = 0; i < header.nodeCount; ++i)
+        {
+            const SnapshotNode& node = nodes[i];
+            switch(node.kind)
+            {
+                case NodeKind::Button:
+                case NodeKind::Line:
+                    if(node.childCount != 0)
+                    {
+                        return "leaf with children";
+                    }
+                    break;
+                case NodeKind::Panel:
+                    if(node.firstChild > header.childCount || node.childCount > header.childCount - node.firstChild)
+                    {
+                        return "child range out of bounds";
+                    }
+                    for(uint32_t c = 0; c < node.childCount; ++c)
+                    {
+                        uint32_t child = children[node.firstChild + c];
+                        if(child >= i)
+                        {
+                            return "child is not stored before its panel";
+                        }
+                        drawn[i] = std::min(drawn[i] + drawn[child], kMaxDrawnNodes + 1);
+                    }
+                    break;
+                default:
+                    return "unknown node kind";
+            }
+        }
+        if(drawn[header.root] > kMaxDrawnNodes)
+        {
+            return "shared panels expand to too many nodes";
+        }
+        return nullptr;
+    }
+
+    //! \brief: Draws the tree exactly as the components it was saved from would.
+    void Draw() const
+    {
+        // An explicit stack of (panel, next child), snapshots can be arbitrarily deep.
+        std::vector<std::pair<uint32_t, uint32_t>> stack;
+        DrawNode(mHeader.root, stack);
+        while(!stack.empty())
+        {
+            auto& [panel, next] = stack.back();
+            if(next == mNodes[panel].childCount)
+            {
+                stack.pop_back();
+                continue;
+            }
+            uint32_t child = mChildren[mNodes[panel].firstChild + next++];
+            DrawNode(child, stack);
+        }
+    }
+
+    size_t nodeCount() const { return mHeader.nodeCount; }
+    const uint8_t* data() const { return mMapping; }
+    size_t size() const { return mMappingSize; }
+
+private:
+    static bool TableFits(const uint8_t* data, size_t size, uint64_t offset, uint64_t count, size_t entrySize, size_t alignment)
+    {
+        return offset >= sizeof(SnapshotHeader) && offset <= size && count <= (size - offset) / entrySize &&
+               reinterpret_cast<uintptr_t>(data + offset) % alignment == 0;
+    }
+
+    void DrawNode(uint32_t node, std::vector<std::pair<uint32_t, uint32_t>>& stack) const
+    {
+        switch(mNodes[node].kind)
+        {
+            case NodeKind::Button:
+                std::cout << Button::kDrawText << std::endl;
+                break;
+            case NodeKind::Line:
+                std::cout << Line::kDrawText << std::endl;
+                break;
+            case NodeKind::Panel:
+                std::cout << Panel::kDrawText << std::endl;
+                if(mNodes[node].childCount > 0)
+                {
+                    stack.emplace_back(node, 0);
+                }
+                break;
+        }
+    }
+
+    const uint8_t* mMapping = nullptr;
+    size_t mMappingSize = 0;
+    SnapshotHeader mHeader{};
+    const SnapshotNode* mNodes = nullptr;
+    const uint32_t* mChildren = nullptr;
+};
+
+int main(int argc, char* argv[])
 {
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return RunChecks();
+    }
+    if(argc > 2 && std::string(argv[1]) == "--load")
+    {
+        try
+        {
+            Snapshot(argv[2]).Draw();
+        }
+        catch(const std::exception& error)
+        {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     auto button = std::make_shared<Button>();
     auto line = std::make_shared<Line>();
 
@@ -80,5 +476,286 @@ int main()
 
     panel->Draw();
 
+    if(argc > 2 && std::string(argv[1]) == "--save")
+    {
+        try
+        {
+            SnapshotWriter().Write(argv[2], *panel);
+        }
+        catch(const std::exception& error)
+        {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    }
+
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+//! \brief: Balanced GUI: panels of `fanout` components for `depth` levels, then buttons and lines.
+std::shared_ptr<GuiComponent> BuildGui(size_t depth, size_t fanout, size_t& nodes)
+{
+    ++nodes;
+    if(depth == 0)
+    {
+        if(nodes & 1)
+        {
+            return std::make_shared<Line>();
+        }
+        return std::make_shared<Button>();
+    }
+
+    auto panel = std::make_shared<Panel>();
+    for(size_t i = 0; i < fanout; ++i)
+    {
+        panel->Add(BuildGui(depth - 1, fanout, nodes));
+    }
+    return panel;
+}
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("composite", argc, argv);
+    bench::MuteStdout mute;
+
+    // One flat panel and the same leaves spread over nested panels.
+    const size_t leaves = 1000;
+    auto flat = std::make_shared<Panel>();
+    auto nested = std::make_shared<Panel>();
+    std::shared_ptr<Panel> current;
+    for(size_t i = 0; i < leaves; ++i)
+    {
+        std::shared_ptr<GuiComponent> leaf;
+        if(i & 1)
+        {
+            leaf = std::make_shared<Line>();
+        }
+        else
+        {
+            leaf = std::make_shared<Button>();
+        }
+        flat->Add(leaf);
+
+        if(i % 10 == 0)
+        {
+            current = std::make_shared<Panel>();
+            nested->Add(current);
+        }
+        current->Add(leaf);
+    }
+
+    harness.run("draw flat panel", leaves, [&] { flat->Draw(); });
+    harness.run("draw nested panels", leaves, [&] { nested->Draw(); });
+
+    // Start to first frame of a ~1M component GUI: constructing and drawing it against
+    // mapping, validating and drawing its snapshot. Both include tearing down the previous
+    // repetition's tree or mapping.
+    size_t nodes = 0;
+    std::shared_ptr<GuiComponent> gui = BuildGui(3, 100, nodes);
+
+    char path[] = "/tmp/composite_snapshot_XXXXXX";
+    int fd = ::mkstemp(path);
+    if(fd < 0)
+    {
+        std::cerr << "Cannot create snapshot file" << std::endl;
+        return;
+    }
+    SnapshotWriter().Write(path, *gui);
+    // Written back, so the cold case can evict the pages.
+    ::fdatasync(fd);
+
+    harness.run("start: build + draw 1M-node tree", nodes, [&] {
+        size_t built = 0;
+        gui = BuildGui(3, 100, built);
+        gui->Draw();
+    });
+    harness.run("start: map + validate + draw, warm", nodes, [&] {
+        Snapshot(path).Draw();
+    });
+
+    // Drops the file from the page cache before every repetition, so the pages are read
+    // from disk again.
+    long majorFaults = 0;
+    size_t starts = 0;
+    harness.run("start: map + validate + draw, cold", nodes, [&] {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        rusage before{};
+        ::getrusage(RUSAGE_SELF, &before);
+        Snapshot(path).Draw();
+        rusage after{};
+        ::getrusage(RUSAGE_SELF, &after);
+        majorFaults += after.ru_majflt - before.ru_majflt;
+        ++starts;
+    });
+    harness.note("%.1f major page faults per start", static_cast<double>(majorFaults) / std::max<size_t>(starts, 1));
+
+    Snapshot snapshot(path);
+    harness.run("validate 1M-node snapshot", nodes, [&] {
+        bench::DoNotOptimize(Snapshot::Validate(snapshot.data(), snapshot.size()));
+    });
+    harness.run("draw 1M-node tree", nodes, [&] { gui->Draw(); });
+    harness.run("draw 1M-node snapshot", nodes, [&] { snapshot.Draw(); });
+
+    ::close(fd);
+    ::unlink(path);
+}
+
+///////////////////////////// Checks ////////////////////////////////////
+
+//! \returns: what `draw` writes to std::cout.
+template<class Draw>
+std::string Drawn(Draw&& draw)
+{
+    std::ostringstream out;
+    std::streambuf* console = std::cout.rdbuf(out.rdbuf());
+    draw();
+    std::cout.rdbuf(console);
+    return out.str();
+}
+
+//! \returns: a snapshot of `root` as written by SnapshotWriter.
+std::vector<uint8_t> Serialized(const GuiComponent& root)
+{
+    SnapshotWriter writer;
+    uint32_t node = writer.Add(root);
+    return writer.Serialize(node);
+}
+
+SnapshotHeader HeaderOf(const std::vector<uint8_t>& bytes)
+{
+    SnapshotHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    return header;
+}
+
+//! \brief: Writes `value` over the `index`th uint32_t of the table at `offset`.
+void Patch(std::vector<uint8_t>& bytes, uint64_t offset, size_t index, uint32_t value)
+{
+    std::memcpy(bytes.data() + offset + index * sizeof(uint32_t), &value, sizeof(value));
+}
+
+void CheckRoundTrip()
+{
+    auto panel = std::make_shared<Panel>();
+    auto inner = std::make_shared<Panel>();
+    auto button = std::make_shared<Button>();
+    inner->Add(button);
+    inner->Add(std::make_shared<Line>());
+    panel->Add(inner);
+    panel->Add(button);
+    panel->Add(inner);
+
+    char path[] = "/tmp/composite_check_XXXXXX";
+    int fd = ::mkstemp(path);
+    CHECK(fd >= 0);
+    ::close(fd);
+    SnapshotWriter().Write(path, *panel);
+
+    Snapshot snapshot(path);
+    CHECK(snapshot.nodeCount() == 4);
+    CHECK(Drawn([&] { snapshot.Draw(); }) == Drawn([&] { panel->Draw(); }));
+    ::unlink(path);
+}
+
+void CheckCorruptSnapshots()
+{
+    auto panel = std::make_shared<Panel>();
+    auto inner = std::make_shared<Panel>();
+    inner->Add(std::make_shared<Button>());
+    inner->Add(std::make_shared<Line>());
+    panel->Add(inner);
+    panel->Add(std::make_shared<Button>());
+
+    const std::vector<uint8_t> valid = Serialized(*panel);
+    const SnapshotHeader header = HeaderOf(valid);
+    CHECK(Snapshot::Validate(valid.data(), valid.size()) == nullptr);
+
+    // Truncated: in the tables and in the header.
+    CHECK(Snapshot::Validate(valid.data(), valid.size() - sizeof(uint32_t)) != nullptr);
+    CHECK(Snapshot::Validate(valid.data(), sizeof(SnapshotHeader) - 1) != nullptr);
+
+    // Misaligned: the same bytes one byte into the buffer.
+    std::vector<uint8_t> shifted(valid.size() + 1);
+    std::memcpy(shifted.data() + 1, valid.data(), valid.size());
+    CHECK(Snapshot::Validate(shifted.data() + 1, valid.size()) != nullptr);
+
+    // Out of range: root, a child reference, a panel's child range and the node table.
+    std::vector<uint8_t> bytes = valid;
+    Patch(bytes, offsetof(SnapshotHeader, root), 0, header.nodeCount);
+    CHECK(Snapshot::Validate(bytes.data(), bytes.size()) != nullptr);
+
+    bytes = valid;
+    Patch(bytes, header.childrenOffset, 0, 1000);
+    CHECK(Snapshot::Validate(bytes.data(), bytes.size()) != nullptr);
+
+    bytes = valid;
+    Patch(bytes, header.nodesOffset, header.root * 3 + 1, header.childCount);
+    CHECK(Snapshot::Validate(bytes.data(), bytes.size()) != nullptr);
+
+    bytes = valid;
+    Patch(bytes, offsetof(SnapshotHeader, nodeCount), 0, header.nodeCount + 100);
+    CHECK(Snapshot::Validate(bytes.data(), bytes.size()) != nullptr);
+
+    // Cyclic: the root panel holding itself, and the inner panel holding the root.
+    bytes = valid;
+    Patch(bytes, header.childrenOffset, header.childCount - 1, header.root);
+    CHECK(Snapshot::Validate(bytes.data(), bytes.size()) != nullptr);
+
+    bytes = valid;
+    Patch(bytes, header.childrenOffset, 0, header.root);
+    CHECK(Snapshot::Validate(bytes.data(), bytes.size()) != nullptr);
+
+    // Unknown node kind.
+    bytes = valid;
+    Patch(bytes, header.nodesOffset, 0, 7);
+    CHECK(Snapshot::Validate(bytes.data(), bytes.size()) != nullptr);
+
+    // The same problems reported by the constructor, for a file.
+    char path[] = "/tmp/composite_check_XXXXXX";
+    int fd = ::mkstemp(path);
+    CHECK(fd >= 0);
+    CHECK(::write(fd, valid.data(), valid.size() - 1) == static_cast<ssize_t>(valid.size() - 1));
+    ::close(fd);
+    bool rejected = false;
+    try
+    {
+        Snapshot snapshot(path);
+    }
+    catch(const std::runtime_error&)
+    {
+        rejected = true;
+    }
+    CHECK(rejected);
+    ::unlink(path);
+}
+
+void CheckSharedPanels()
+{
+    // Every level holds the level below twice, so drawing the top visits 2^(levels + 1) - 1 nodes.
+    auto sharedTree = [](size_t levels) {
+        SnapshotWriter writer;
+        uint32_t node = writer.AddNode(NodeKind::Button);
+        for(size_t i = 0; i < levels; ++i)
+        {
+            node = writer.AddNode(NodeKind::Panel, {node, node});
+        }
+        return writer.Serialize(node);
+    };
+
+    std::vector<uint8_t> small = sharedTree(10);
+    CHECK(Snapshot::Validate(small.data(), small.size()) == nullptr);
+
+    std::vector<uint8_t> bomb = sharedTree(64);
+    CHECK(Snapshot::Validate(bomb.data(), bomb.size()) != nullptr);
+    CHECK(Snapshot::Validate(bomb.data(), bomb.size(), Snapshot::Check::Header) == nullptr);
+}
+
+int RunChecks()
+{
+    CheckRoundTrip();
+    CheckCorruptSnapshots();
+    CheckSharedPanels();
+    return check::Report("composite");
+}
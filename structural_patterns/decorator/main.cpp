@@ -1,5 +1,27 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <list>
+#include <new>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DECORATOR_HAS_X86_KERNELS 1
+#endif
+
+#include "../../benchmarks/bench.h"
+#include "../../tests/check.h"
+#include "../../tracing/trace.h"
 
 // The Decorator design pattern is a structural design pattern in C++ that allows you to dynamically   
 // add behaviors or responsibilities to objects without altering their code.
@@ -24,10 +46,15 @@
 // Concrete Decorators
 //      These are concrete classes derived from the Decorator class. They add specific functionality to the 
 //      wrapped Component.
+//
+// Built with `make trace` every format() call of the chain is recorded as a trace span and
+// the demo writes decorator.trace.json (Chrome trace-event format).
 
 // App std out:
 //
 // Formatted Text: <u><i><b>Hello, Decorator Pattern!</b></i></u>
+// Transformed Text:  FISH &amp; &lt;CHIPS&gt; &quot;TO GO&quot; 
+// Cache hit ratio: 0.5
 //
 // NewDecorator::f(), calling DecoratorBaseClass::f()
 // DecoratorClass::f(), calling  mBase->f()
@@ -43,6 +70,13 @@
 //! \brief: POC for the class structure used in this pattern. 
 void ClassStructurePoc();
 
+//! \brief: Times the example's hot paths and the SIMD kernels with the shared harness.
+//!         Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
+
+//! \brief: Runs the example's self-checks. Run with `./app --check`.
+int RunChecks();
+
 // Component Interface
 class TextFormat 
 {
@@ -52,11 +86,12 @@ public:
 };
 
 // Concrete Component
-class PlainText : public TextFormat 
+class PlainText final : public TextFormat 
 {
 public:
     std::string format(const std::string& text) override 
     {
+        TRACE_SPAN("PlainText::format");
         return text;
     }
 };
@@ -76,54 +111,623 @@ public:
 };
 
 // Concrete Decorators
-class BoldText : public TextDecorator 
+class BoldText final : public TextDecorator 
 {
 public:
     BoldText(TextFormat* text) : TextDecorator(text) {}
 
     std::string format(const std::string& text) override 
     {
+        TRACE_SPAN("BoldText::format");
         return "<b>" + TextDecorator::format(text) + "</b>";
     }
 };
 
-class ItalicText : public TextDecorator {
+class ItalicText final : public TextDecorator {
 public:
     ItalicText(TextFormat* text) : TextDecorator(text) {}
 
     std::string format(const std::string& text) override 
     {
+        TRACE_SPAN("ItalicText::format");
         return "<i>" + TextDecorator::format(text) + "</i>";
     }
 };
 
-class UnderlineText : public TextDecorator 
+class UnderlineText final : public TextDecorator 
 {
 public:
     UnderlineText(TextFormat* text) : TextDecorator(text) {}
 
     std::string format(const std::string& text) override 
     {
+        TRACE_SPAN("UnderlineText::format");
         return "<u>" + TextDecorator::format(text) + "</u>";
     }
 };
 
-int main() 
+// Content transforming decorators
+//
+// Unlike the tag decorators above, these decorators rewrite the text produced by the
+// wrapped component. They are meant for large payloads, so each one is driven by a
+// scanning kernel that looks at 16 (SSE2) or 32 (AVX2) bytes at a time, finds the next
+// byte that needs special handling and bulk-copies the clean run before it.
+// The scalar kernels are the reference implementation the SIMD ones must match.
+namespace kernels
+{
+    enum class Isa
+    {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    const char* IsaName(Isa isa)
+    {
+        switch(isa)
+        {
+            case Isa::Sse2: return "sse2";
+            case Isa::Avx2: return "avx2";
+            default:        return "scalar";
+        }
+    }
+
+    inline bool NeedsEscape(unsigned char c)
+    {
+        return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+    }
+
+    // ' ', '\t', '\n', '\v', '\f', '\r'
+    inline bool IsSpace(unsigned char c)
+    {
+        return c == ' ' || static_cast<unsigned char>(c - '\t') <= 4;
+    }
+
+    //! \returns: index of the first byte in [p, p + n) matching the predicate, or n.
+    template<bool (*Pred)(unsigned char)>
+    size_t FindScalar(const char* p, size_t n)
+    {
+        for(size_t i = 0; i < n; ++i)
+        {
+            if(Pred(static_cast<unsigned char>(p[i])))
+            {
+                return i;
+            }
+        }
+        return n;
+    }
+
+    void UpperScalar(const char* src, char* dst, size_t n)
+    {
+        for(size_t i = 0; i < n; ++i)
+        {
+            unsigned char c = static_cast<unsigned char>(src[i]);
+            dst[i] = static_cast<char>(static_cast<unsigned char>(c - 'a') <= 25 ? c - 0x20 : c);
+        }
+    }
+
+#ifdef DECORATOR_HAS_X86_KERNELS
+    // Unsigned "lo <= v <= lo + span" per byte: min_epu8(v - lo, span) == v - lo.
+    inline __m128i InRange128(__m128i v, char lo, char span)
+    {
+        __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+        return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(span)), t);
+    }
+
+    inline __m128i EscapeMask128(__m128i v)
+    {
+        __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8('&'));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+    }
+
+    inline __m128i SpaceMask128(__m128i v)
+    {
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), InRange128(v, '\t', 4));
+    }
+
+    template<__m128i (*Mask)(__m128i), bool (*Pred)(unsigned char)>
+    size_t FindSse2(const char* p, size_t n)
+    {
+        size_t i = 0;
+        for(; i + 16 <= n; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            int bits = _mm_movemask_epi8(Mask(v));
+            if(bits)
+            {
+                return i + __builtin_ctz(bits);
+            }
+        }
+        return i + FindScalar<Pred>(p + i, n - i);
+    }
+
+    void UpperSse2(const char* src, char* dst, size_t n)
+    {
+        size_t i = 0;
+        for(; i + 16 <= n; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i lower = InRange128(v, 'a', 25);
+            v = _mm_sub_epi8(v, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        UpperScalar(src + i, dst + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i InRange256(__m256i v, char lo, char span)
+    {
+        __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(span)), t);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i EscapeMask256(__m256i v)
+    {
+        __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&'));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        return _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i SpaceMask256(__m256i v)
+    {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), InRange256(v, '\t', 4));
+    }
+
+    template<__m256i (*Mask)(__m256i), bool (*Pred)(unsigned char)>
+    __attribute__((target("avx2")))
+    size_t FindAvx2(const char* p, size_t n)
+    {
+        size_t i = 0;
+        for(; i + 32 <= n; i += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+            unsigned bits = static_cast<unsigned>(_mm256_movemask_epi8(Mask(v)));
+            if(bits)
+            {
+                return i + __builtin_ctz(bits);
+            }
+        }
+        return i + FindScalar<Pred>(p + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    void UpperAvx2(const char* src, char* dst, size_t n)
+    {
+        size_t i = 0;
+        for(; i + 32 <= n; i += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i lower = InRange256(v, 'a', 25);
+            v = _mm256_sub_epi8(v, _mm256_and_si256(lower, _mm256_set1_epi8(0x20)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        }
+        UpperScalar(src + i, dst + i, n - i);
+    }
+#endif
+
+    //! \brief: Best instruction set supported by the running CPU.
+    Isa DetectIsa()
+    {
+#ifdef DECORATOR_HAS_X86_KERNELS
+        if(__builtin_cpu_supports("avx2"))
+        {
+            return Isa::Avx2;
+        }
+        return Isa::Sse2;
+#else
+        return Isa::Scalar;
+#endif
+    }
+
+    //! \brief: Instruction sets that can be exercised on this CPU, scalar first.
+    std::vector<Isa> AvailableIsas()
+    {
+        std::vector<Isa> isas{Isa::Scalar};
+#ifdef DECORATOR_HAS_X86_KERNELS
+        isas.push_back(Isa::Sse2);
+        if(__builtin_cpu_supports("avx2"))
+        {
+            isas.push_back(Isa::Avx2);
+        }
+#endif
+        return isas;
+    }
+
+    using FindFn = size_t (*)(const char*, size_t);
+    using UpperFn = void (*)(const char*, char*, size_t);
+
+    FindFn EscapeFinder(Isa isa)
+    {
+#ifdef DECORATOR_HAS_X86_KERNELS
+        if(isa == Isa::Avx2) return FindAvx2<EscapeMask256, NeedsEscape>;
+        if(isa == Isa::Sse2) return FindSse2<EscapeMask128, NeedsEscape>;
+#endif
+        (void)isa;
+        return FindScalar<NeedsEscape>;
+    }
+
+    FindFn SpaceFinder(Isa isa)
+    {
+#ifdef DECORATOR_HAS_X86_KERNELS
+        if(isa == Isa::Avx2) return FindAvx2<SpaceMask256, IsSpace>;
+        if(isa == Isa::Sse2) return FindSse2<SpaceMask128, IsSpace>;
+#endif
+        (void)isa;
+        return FindScalar<IsSpace>;
+    }
+
+    UpperFn Upper(Isa isa)
+    {
+#ifdef DECORATOR_HAS_X86_KERNELS
+        if(isa == Isa::Avx2) return UpperAvx2;
+        if(isa == Isa::Sse2) return UpperSse2;
+#endif
+        (void)isa;
+        return UpperScalar;
+    }
+}
+
+// Concrete Decorator: replaces & < > " ' with HTML entities.
+// Escaping belongs on the outside of a chain: layers above it see the entities as text, so
+// an UppercaseText above it would turn &amp; into &AMP;.
+class HtmlEscapeText final : public TextDecorator
+{
+public:
+    HtmlEscapeText(TextFormat* text, kernels::Isa isa = kernels::DetectIsa())
+        : TextDecorator(text), mFind(kernels::EscapeFinder(isa)) {}
+
+    std::string format(const std::string& text) override
+    {
+        TRACE_SPAN("HtmlEscapeText::format");
+        std::string in = TextDecorator::format(text);
+        std::string out;
+        out.reserve(in.size() + in.size() / 8);
+
+        const char* p = in.data();
+        size_t n = in.size();
+        size_t pos = 0;
+        while(pos < n)
+        {
+            size_t run = mFind(p + pos, n - pos);
+            out.append(p + pos, run);
+            pos += run;
+            if(pos == n)
+            {
+                break;
+            }
+            switch(p[pos])
+            {
+                case '&':  out.append("&amp;");  break;
+                case '<':  out.append("&lt;");   break;
+                case '>':  out.append("&gt;");   break;
+                case '"':  out.append("&quot;"); break;
+                default:   out.append("&#39;");  break;
+            }
+            ++pos;
+        }
+        return out;
+    }
+
+private:
+    kernels::FindFn mFind;
+};
+
+// Concrete Decorator: ASCII uppercase, other bytes are left untouched.
+class UppercaseText final : public TextDecorator
+{
+public:
+    UppercaseText(TextFormat* text, kernels::Isa isa = kernels::DetectIsa())
+        : TextDecorator(text), mUpper(kernels::Upper(isa)) {}
+
+    std::string format(const std::string& text) override
+    {
+        TRACE_SPAN("UppercaseText::format");
+        std::string in = TextDecorator::format(text);
+        mUpper(in.data(), &in[0], in.size());
+        return in;
+    }
+
+private:
+    kernels::UpperFn mUpper;
+};
+
+// Concrete Decorator: every run of whitespace becomes a single ' '.
+class CollapseWhitespaceText final : public TextDecorator
+{
+public:
+    CollapseWhitespaceText(TextFormat* text, kernels::Isa isa = kernels::DetectIsa())
+        : TextDecorator(text), mFind(kernels::SpaceFinder(isa)) {}
+
+    std::string format(const std::string& text) override
+    {
+        TRACE_SPAN("CollapseWhitespaceText::format");
+        std::string in = TextDecorator::format(text);
+        std::string out;
+        out.reserve(in.size());
+
+        const char* p = in.data();
+        size_t n = in.size();
+        size_t pos = 0;
+        while(pos < n)
+        {
+            size_t run = mFind(p + pos, n - pos);
+            out.append(p + pos, run);
+            pos += run;
+            if(pos == n)
+            {
+                break;
+            }
+            while(pos < n && kernels::IsSpace(static_cast<unsigned char>(p[pos])))
+            {
+                ++pos;
+            }
+            out.push_back(' ');
+        }
+        return out;
+    }
+
+private:
+    kernels::FindFn mFind;
+};
+
+// 64 bit wyhash style hash: 8 bytes per step, folded with a 64x64->128 multiply.
+inline uint64_t HashMix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+    // No 128 bit integer (e.g. 32 bit targets): the same product from four 32x32->64 ones.
+    uint64_t aLow = a & 0xffffffffu, aHigh = a >> 32;
+    uint64_t bLow = b & 0xffffffffu, bHigh = b >> 32;
+    uint64_t lowLow = aLow * bLow;
+    uint64_t lowHigh = aLow * bHigh;
+    uint64_t highLow = aHigh * bLow;
+    uint64_t highHigh = aHigh * bHigh;
+    uint64_t middle = (lowLow >> 32) + (lowHigh & 0xffffffffu) + (highLow & 0xffffffffu);
+    uint64_t low = (middle << 32) | (lowLow & 0xffffffffu);
+    uint64_t high = highHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+    return low ^ high;
+#endif
+}
+
+uint64_t HashBytes(const char* p, size_t n, uint64_t seed = 0xa0761d6478bd642full)
+{
+    const uint64_t k1 = 0xe7037ed1a0b428dbull;
+    const uint64_t k2 = 0x8ebc6af09c88c6e3ull;
+    uint64_t h = seed ^ HashMix(n ^ k1, k2);
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        h = HashMix(h ^ word, k1);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, p + i, n - i);
+    return HashMix(h ^ tail ^ k2, k1 ^ n);
+}
+
+// Concrete Decorator: memoizes the output of the wrapped chain.
+//
+// Can be inserted at any point of a chain; everything below it is only evaluated on a miss.
+// Entries are keyed by a hash of the input, the input itself is kept to resolve collisions.
+// Input + output bytes of all entries are kept under the byte budget by evicting the least
+// recently used entries.
+class CachingDecorator final : public TextDecorator
+{
+public:
+    CachingDecorator(TextFormat* text, size_t byteBudget = 16 * 1024 * 1024)
+        : TextDecorator(text), mByteBudget(byteBudget) {}
+
+    std::string format(const std::string& text) override
+    {
+        TRACE_SPAN("CachingDecorator::format");
+        uint64_t hash = HashBytes(text.data(), text.size());
+
+        auto range = mIndex.equal_range(hash);
+        for(auto it = range.first; it != range.second; ++it)
+        {
+            if(it->second->input == text)
+            {
+                ++mHits;
+                mEntries.splice(mEntries.begin(), mEntries, it->second);
+                return it->second->output;
+            }
+        }
+
+        ++mMisses;
+        std::string result = TextDecorator::format(text);
+        size_t cost = text.size() + result.size();
+        if(cost <= mByteBudget)
+        {
+            while(mBytesUsed + cost > mByteBudget)
+            {
+                EvictOldest();
+            }
+            mEntries.push_front(Entry{hash, text, result});
+            mIndex.emplace(hash, mEntries.begin());
+            mBytesUsed += cost;
+        }
+        return result;
+    }
+
+    uint64_t hits() const { return mHits; }
+    uint64_t misses() const { return mMisses; }
+    uint64_t evictions() const { return mEvictions; }
+    size_t bytesUsed() const { return mBytesUsed; }
+    size_t entries() const { return mEntries.size(); }
+
+    double hitRatio() const
+    {
+        uint64_t total = mHits + mMisses;
+        return total ? static_cast<double>(mHits) / total : 0.0;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        std::string input;
+        std::string output;
+    };
+
+    void EvictOldest()
+    {
+        const Entry& victim = mEntries.back();
+        auto range = mIndex.equal_range(victim.hash);
+        for(auto it = range.first; it != range.second; ++it)
+        {
+            if(&*it->second == &victim)
+            {
+                mIndex.erase(it);
+                break;
+            }
+        }
+        mBytesUsed -= victim.input.size() + victim.output.size();
+        mEntries.pop_back();
+        ++mEvictions;
+    }
+
+    size_t mByteBudget;
+    size_t mBytesUsed = 0;
+    std::list<Entry> mEntries;  // most recently used first
+    std::unordered_multimap<uint64_t, std::list<Entry>::iterator> mIndex;
+
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+    uint64_t mEvictions = 0;
+};
+
+// Owns a whole decorator chain in one contiguous buffer.
+//
+// Layers are placement-constructed one after another into a single block, each new layer
+// wrapping the previous one, so a chain costs one allocation (or none when the caller
+// provides the buffer) and one free. Destruction runs the layer destructors innermost last.
+//
+//      DecoratorChain chain;
+//      chain.add<PlainText>().add<BoldText>().add<ItalicText>();
+//      chain->format("text");
+class DecoratorChain
+{
+public:
+    //! \brief: Allocates a single block of `capacity` bytes for all layers.
+    explicit DecoratorChain(size_t capacity = 256)
+        : mBuffer(static_cast<char*>(::operator new(capacity))), mCapacity(capacity), mOwnsBuffer(true) {}
+
+    //! \brief: Builds the chain inside caller provided storage, no allocation at all.
+    DecoratorChain(void* buffer, size_t capacity)
+        : mBuffer(static_cast<char*>(buffer)), mCapacity(capacity), mOwnsBuffer(false) {}
+
+    DecoratorChain(const DecoratorChain&) = delete;
+    DecoratorChain& operator=(const DecoratorChain&) = delete;
+
+    ~DecoratorChain()
+    {
+        for(Layer* layer = mTop; layer; layer = layer->below)
+        {
+            layer->object->~TextFormat();
+        }
+        if(mOwnsBuffer)
+        {
+            ::operator delete(mBuffer);
+        }
+    }
+
+    //! \brief: Adds the next layer. The first layer is the concrete component and is built
+    //!         from `args`, decorators also receive the current head as first argument.
+    template<class T, class... Args>
+    DecoratorChain& add(Args&&... args)
+    {
+        static_assert(std::is_base_of<TextFormat, T>::value, "layers must implement TextFormat");
+        if(std::is_base_of<TextDecorator, T>::value && !mTop)
+        {
+            throw std::logic_error("DecoratorChain needs a concrete component before decorators");
+        }
+
+        Layer* layer = new (allocate(sizeof(Layer), alignof(Layer))) Layer{mTop, nullptr};
+        void* storage = allocate(sizeof(T), alignof(T));
+        if constexpr(std::is_base_of<TextDecorator, T>::value)
+        {
+            layer->object = new (storage) T(mTop->object, std::forward<Args>(args)...);
+        }
+        else
+        {
+            layer->object = new (storage) T(std::forward<Args>(args)...);
+        }
+        mTop = layer;
+        return *this;
+    }
+
+    TextFormat* head() const { return mTop ? mTop->object : nullptr; }
+    TextFormat* operator->() const { return head(); }
+    size_t bytesUsed() const { return mUsed; }
+
+private:
+    struct Layer
+    {
+        Layer* below;
+        TextFormat* object;
+    };
+
+    void* allocate(size_t size, size_t alignment)
+    {
+        size_t offset = (mUsed + alignment - 1) & ~(alignment - 1);
+        if(offset + size > mCapacity)
+        {
+            throw std::length_error("DecoratorChain buffer is too small for another layer");
+        }
+        mUsed = offset + size;
+        return mBuffer + offset;
+    }
+
+    char* mBuffer;
+    size_t mCapacity;
+    bool mOwnsBuffer;
+    size_t mUsed = 0;
+    Layer* mTop = nullptr;
+};
+
+int main(int argc, char* argv[]) 
 {
-    TextFormat* plainText = new PlainText();
-    TextFormat* boldText = new BoldText(plainText);
-    TextFormat* italicText = new ItalicText(boldText);
-    TextFormat* formattedText = new UnderlineText(italicText);
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return RunChecks();
+    }
+
+    TRACE_SESSION("decorator.trace.json");
+
+    DecoratorChain formattedText;
+    formattedText.add<PlainText>().add<BoldText>().add<ItalicText>().add<UnderlineText>();
 
     std::string text = "Hello, Decorator Pattern!";
     std::string result = formattedText->format(text);
 
     std::cout << "Formatted Text: " << result << std::endl;
 
-    delete formattedText;
-    delete italicText;
-    delete boldText;
-    delete plainText;
+    DecoratorChain shouted;
+    shouted.add<PlainText>().add<CollapseWhitespaceText>().add<UppercaseText>().add<HtmlEscapeText>();
+
+    std::cout << "Transformed Text: " << shouted->format("  Fish   & <Chips>\n\t\"to go\" ") << std::endl;
+
+    CachingDecorator cached(shouted.head());
+    cached.format("Repeated <text>");
+    cached.format("Repeated <text>");
+    std::cout << "Cache hit ratio: " << cached.hitRatio() << std::endl;
+    std::cout << std::endl;
 
     ClassStructurePoc();
 
@@ -136,6 +740,7 @@ class BaseClassInterface
 {
 public:
     virtual void f() = 0;
+    virtual ~BaseClassInterface() = default;
 };
 
 class BaseClass : public BaseClassInterface
@@ -164,7 +769,7 @@ public:
     }
 };
 
-class NewDecorator : public DecoratorBaseClass
+class NewDecorator final : public DecoratorBaseClass
 {
 public:
 
@@ -189,4 +794,374 @@ void ClassStructurePoc()
     BaseClassInterface *decPtr4 = new NewDecorator(decPtr3);
 
     decPtr4->f();
+
+    delete decPtr4;
+    delete decPtr3;
+    delete decPtr2;
+    delete decPtr1;
+    delete ptr1;
+}
+
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+std::string RandomText(std::mt19937& rng, size_t length, const std::string& alphabet)
+{
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    std::string text(length, ' ');
+    for(auto& c : text)
+    {
+        c = alphabet[pick(rng)];
+    }
+    return text;
+}
+
+//! \brief: Throughput of every transform decorator on every ISA this CPU supports.
+void BenchmarkKernels(bench::Harness& harness)
+{
+    std::mt19937 rng(42);
+    // Mostly clean prose with the occasional special character, like real markup payloads.
+    std::string alphabet(200, 'a');
+    for(size_t i = 0; i < alphabet.size(); ++i)
+    {
+        alphabet[i] = static_cast<char>('a' + i % 26);
+    }
+    alphabet += "        ABCDEFG&<\n";
+    const std::string payload = RandomText(rng, 1024 * 1024, alphabet);
+
+    PlainText plain;
+    for(auto isa : kernels::AvailableIsas())
+    {
+        HtmlEscapeText escape(&plain, isa);
+        UppercaseText upper(&plain, isa);
+        CollapseWhitespaceText collapse(&plain, isa);
+
+        std::pair<const char*, TextFormat*> decorators[] = {
+            {"html-escape", &escape}, {"uppercase", &upper}, {"collapse-ws", &collapse}};
+
+        for(auto& [name, decorator] : decorators)
+        {
+            harness.run(std::string(name) + " [" + kernels::IsaName(isa) + "], per byte", payload.size(),
+                        [&, decorator = decorator] { bench::DoNotOptimize(decorator->format(payload)); });
+        }
+    }
+}
+
+//! \brief: Formats a Zipf distributed request stream (a few hot strings, a long tail of cold
+//!         ones) through a five layer chain, with and without a cache on top.
+void BenchmarkCachingDecorator(bench::Harness& harness)
+{
+    const size_t distinct = 20000;
+    const size_t requests = 20000;
+
+    std::mt19937 rng(7);
+    std::vector<std::string> corpus;
+    corpus.reserve(distinct);
+    for(size_t i = 0; i < distinct; ++i)
+    {
+        corpus.push_back(RandomText(rng, 64 + i % 512, "lorem ipsum & <dolor> sit \"amet\"\n"));
+    }
+
+    std::vector<double> weights(distinct);
+    for(size_t i = 0; i < distinct; ++i)
+    {
+        weights[i] = 1.0 / (i + 1);
+    }
+    std::discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+    std::vector<size_t> stream(requests);
+    for(auto& index : stream)
+    {
+        index = zipf(rng);
+    }
+
+    PlainText plain;
+    CollapseWhitespaceText collapse(&plain);
+    HtmlEscapeText escape(&collapse);
+    BoldText bold(&escape);
+    ItalicText italic(&bold);
+    UnderlineText chain(&italic);
+    CachingDecorator cached(&chain, 4 * 1024 * 1024);
+
+    auto formatStream = [&](TextFormat& head) {
+        size_t checksum = 0;
+        for(size_t index : stream)
+        {
+            checksum += head.format(corpus[index]).size();
+        }
+        return checksum;
+    };
+
+    harness.run("zipf stream, uncached 5 layer chain", requests, [&] { bench::DoNotOptimize(formatStream(chain)); });
+    harness.run("zipf stream, cached 5 layer chain", requests, [&] { bench::DoNotOptimize(formatStream(cached)); });
+    harness.note("hit ratio %.3f, %llu evictions, %zu bytes cached", cached.hitRatio(),
+                 static_cast<unsigned long long>(cached.evictions()), cached.bytesUsed());
+}
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("decorator", argc, argv);
+
+    const size_t calls = 1000;
+    DecoratorChain tags;
+    tags.add<PlainText>().add<BoldText>().add<ItalicText>().add<UnderlineText>();
+    std::string title = "Hello, Decorator Pattern!";
+    harness.run("format through 3 tag decorators", calls, [&] {
+        for(size_t i = 0; i < calls; ++i)
+        {
+            bench::DoNotOptimize(tags->format(title));
+        }
+    });
+
+    std::mt19937 rng(7);
+    std::string page = RandomText(rng, 64 * 1024, "abcdefghij  \t\n<>&\"'ABCDEFGHIJklmnopqrstuvwxyz");
+    DecoratorChain transform;
+    transform.add<PlainText>().add<CollapseWhitespaceText>().add<UppercaseText>().add<HtmlEscapeText>();
+    harness.run("transform chain, per byte", page.size(), [&] {
+        bench::DoNotOptimize(transform->format(page));
+    });
+
+    CachingDecorator cached(transform.head());
+    std::string paragraph = page.substr(0, 1024);
+    cached.format(paragraph);
+    harness.run("cached transform hit, 1 KiB", calls, [&] {
+        for(size_t i = 0; i < calls; ++i)
+        {
+            bench::DoNotOptimize(cached.format(paragraph));
+        }
+    });
+
+    // Short lived chains: a node per layer (new/delete) against DecoratorChain on the heap
+    // and in a stack buffer.
+    harness.run("build 4 layer chain", calls, [&] {
+        for(size_t i = 0; i < calls; ++i)
+        {
+            DecoratorChain chain;
+            chain.add<PlainText>().add<BoldText>().add<ItalicText>().add<UnderlineText>();
+            bench::DoNotOptimize(chain.head());
+        }
+    });
+    harness.run("build 4 layer chain, new/delete", calls, [&] {
+        for(size_t i = 0; i < calls; ++i)
+        {
+            TextFormat* plain = new PlainText();
+            TextFormat* bold = new BoldText(plain);
+            TextFormat* italic = new ItalicText(bold);
+            TextFormat* underline = new UnderlineText(italic);
+            bench::DoNotOptimize(underline);
+            delete underline;
+            delete italic;
+            delete bold;
+            delete plain;
+        }
+    });
+    harness.run("build 4 layer chain, stack buffer", calls, [&] {
+        for(size_t i = 0; i < calls; ++i)
+        {
+            alignas(std::max_align_t) char buffer[256];
+            DecoratorChain chain(buffer, sizeof(buffer));
+            chain.add<PlainText>().add<BoldText>().add<ItalicText>().add<UnderlineText>();
+            bench::DoNotOptimize(chain.head());
+        }
+    });
+
+    BenchmarkKernels(harness);
+    BenchmarkCachingDecorator(harness);
+}
+
+///////////////////////////// Checks ////////////////////////////////////
+
+//! \brief: Feeds random, special-character heavy inputs of every length around the
+//!         vector widths through each ISA and compares the result with the scalar kernel.
+//!         Also runs the demo's transform chain, which must escape after uppercasing.
+void CheckTransformKernels()
+{
+    std::mt19937 rng(12345);
+    std::string alphabet = "abcXYZ09 &<>\"'\t\n\r\v\f";
+    alphabet.push_back('\x7f');
+    alphabet.push_back('\x80');
+    alphabet.push_back('\xff');
+
+    PlainText plain;
+    HtmlEscapeText escapeRef(&plain, kernels::Isa::Scalar);
+    UppercaseText upperRef(&plain, kernels::Isa::Scalar);
+    CollapseWhitespaceText collapseRef(&plain, kernels::Isa::Scalar);
+
+    for(auto isa : kernels::AvailableIsas())
+    {
+        HtmlEscapeText escape(&plain, isa);
+        UppercaseText upper(&plain, isa);
+        CollapseWhitespaceText collapse(&plain, isa);
+
+        size_t mismatches = 0;
+        for(int iteration = 0; iteration < 20000; ++iteration)
+        {
+            std::string input = RandomText(rng, iteration % 200, alphabet);
+            mismatches += escape.format(input) != escapeRef.format(input) ||
+                          upper.format(input) != upperRef.format(input) ||
+                          collapse.format(input) != collapseRef.format(input);
+        }
+        if(mismatches != 0)
+        {
+            std::cerr << "Kernel mismatch for " << kernels::IsaName(isa) << std::endl;
+        }
+        CHECK(mismatches == 0);
+
+        DecoratorChain transform;
+        transform.add<PlainText>().add<CollapseWhitespaceText>(isa).add<UppercaseText>(isa).add<HtmlEscapeText>(isa);
+        CHECK(transform->format("  Fish   & <Chips>\n\t\"to go\" ") == " FISH &amp; &lt;CHIPS&gt; &quot;TO GO&quot; ");
+    }
+}
+
+//! \brief: A cache small enough to evict must still return what the chain below returns.
+void CheckCachingDecorator()
+{
+    std::mt19937 rng(99);
+    std::vector<std::string> corpus;
+    for(size_t i = 0; i < 200; ++i)
+    {
+        corpus.push_back(RandomText(rng, 16 + i % 64, "ab <c> & \"d\"\n"));
+    }
+
+    PlainText plain;
+    HtmlEscapeText escape(&plain);
+    BoldText chain(&escape);
+    CachingDecorator cached(&chain, 2048);
+
+    std::uniform_int_distribution<size_t> pick(0, corpus.size() - 1);
+    size_t mismatches = 0;
+    for(size_t i = 0; i < 5000; ++i)
+    {
+        const std::string& text = corpus[pick(rng)];
+        mismatches += cached.format(text) != chain.format(text);
+    }
+    CHECK(mismatches == 0);
+    CHECK(cached.evictions() > 0);
+    CHECK(cached.bytesUsed() <= 2048);
+}
+
+// Layers that log their destruction, to check the order DecoratorChain tears down in.
+class LoggedText final : public TextFormat
+{
+public:
+    explicit LoggedText(std::vector<int>& log) : mLog(log) {}
+    ~LoggedText() override { mLog.push_back(0); }
+
+    std::string format(const std::string& text) override { return text; }
+
+private:
+    std::vector<int>& mLog;
+};
+
+class LoggedDecorator final : public TextDecorator
+{
+public:
+    LoggedDecorator(TextFormat* text, std::vector<int>& log, int id) : TextDecorator(text), mLog(log), mId(id) {}
+    ~LoggedDecorator() override { mLog.push_back(mId); }
+
+    std::string format(const std::string& text) override { return "[" + TextDecorator::format(text) + "]"; }
+
+private:
+    std::vector<int>& mLog;
+    int mId;
+};
+
+//! \brief: Chains on the heap and in a caller buffer format like the same layers built with
+//!         new, are destroyed outermost first, and report a full buffer without losing the
+//!         layers built so far. `make check-sanitize` runs this under ASan, which also
+//!         reports any layer or buffer that leaks.
+void CheckDecoratorChain()
+{
+    PlainText plain;
+    BoldText bold(&plain);
+    ItalicText italic(&bold);
+    UnderlineText underline(&italic);
+    const std::string expected = underline.format("text");
+
+    for(size_t i = 0; i < 1000; ++i)
+    {
+        DecoratorChain chain;
+        chain.add<PlainText>().add<BoldText>().add<ItalicText>().add<UnderlineText>();
+        if(i == 0)
+        {
+            CHECK(chain->format("text") == expected);
+            CHECK(chain.bytesUsed() > 0 && chain.bytesUsed() <= 256);
+        }
+    }
+    alignas(std::max_align_t) char buffer[256];
+    {
+        DecoratorChain chain(buffer, sizeof(buffer));
+        chain.add<PlainText>().add<BoldText>().add<ItalicText>().add<UnderlineText>();
+        CHECK(chain->format("text") == expected);
+    }
+
+    std::vector<int> log;
+    {
+        DecoratorChain chain;
+        chain.add<LoggedText>(log).add<LoggedDecorator>(log, 1).add<LoggedDecorator>(log, 2).add<LoggedDecorator>(log, 3);
+        CHECK(chain->format("x") == "[[[x]]]");
+        CHECK(log.empty());
+    }
+    CHECK((log == std::vector<int>{3, 2, 1, 0}));
+
+    // Decorators are added to a small buffer until it is full.
+    log.clear();
+    int built = 0;
+    {
+        alignas(std::max_align_t) char small[256];
+        DecoratorChain chain(small, sizeof(small));
+        chain.add<LoggedText>(log);
+        bool full = false;
+        try
+        {
+            while(built < 100)
+            {
+                chain.add<LoggedDecorator>(log, built + 1);
+                ++built;
+            }
+        }
+        catch(const std::length_error&)
+        {
+            full = true;
+        }
+        CHECK(full);
+        CHECK(built > 0);
+        CHECK(chain.bytesUsed() <= sizeof(small));
+        CHECK(chain->format("x") == std::string(built, '[') + "x" + std::string(built, ']'));
+    }
+    // The layers built before the throw are destroyed exactly once, outermost first.
+    std::vector<int> expectedLog;
+    for(int id = built; id >= 0; --id)
+    {
+        expectedLog.push_back(id);
+    }
+    CHECK(log == expectedLog);
+
+    bool rejected = false;
+    try
+    {
+        DecoratorChain chain;
+        chain.add<BoldText>();
+    }
+    catch(const std::logic_error&)
+    {
+        rejected = true;
+    }
+    CHECK(rejected);
+}
+
+//! \brief: Runs the class structure POC, which used to leak all five objects. The check is
+//!         only meaningful under `make check-sanitize`, where LeakSanitizer fails the run.
+void CheckClassStructurePoc()
+{
+    bench::MuteStdout mute;
+    ClassStructurePoc();
+}
+
+int RunChecks()
+{
+    CheckTransformKernels();
+    CheckCachingDecorator();
+    CheckDecoratorChain();
+    CheckClassStructurePoc();
+    return check::Report("decorator");
 }
@@ -1,4 +1,33 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../benchmarks/bench.h"
+#include "../../tests/check.h"
+#include "../../tracing/trace.h"
 
 // Facade design pattern
 //
@@ -13,81 +42,1297 @@
 // such as video playback, audio playback, and subtitles. These subsystems have their 
 // own complex interactions and initialization. We'll create a Facade to simplify the 
 // client's interaction with the multimedia system.
+//
+// The facade also hides how the subsystems are brought up: they are described as an
+// init graph, independent subsystems start concurrently and optional ones (subtitles)
+// can be deferred until their first use.
+//
+// Behind the same facade sits a playback engine (see PlaybackEngine) that decodes and
+// presents synthetic streams concurrently, keeping them in sync with a master clock,
+// and an input path that feeds local files to the subsystems without copying them.
+//
+// Built with `make trace` subsystem startup, playback and the pipeline stages are recorded
+// as trace spans and the app writes facade.trace.json (Chrome trace-event format).
+
+//! \brief: Times the example's hot paths, serial, parallel and lazy startup, the playback
+//!         pipeline and the file input paths with the shared harness. Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
+
+//! \brief: Runs the example's self-checks. Run with `./app --check`.
+int RunChecks();
+
+// Simulated cost of a subsystem's initialize(), zero for the demo.
+using InitCost = std::chrono::milliseconds;
+
+void SimulateWork(InitCost cost)
+{
+    if(cost.count() > 0)
+    {
+        std::this_thread::sleep_for(cost);
+    }
+}
+
+// Playback pipeline primitives
+//
+// playMultimedia(SyntheticMedia) runs a real pipeline: a demux thread splits the input into
+// per-stream packets, one decode thread per stream turns packets into frames and the
+// caller's thread presents them against a master clock. Stages are connected by bounded
+// single producer / single consumer rings and frames come from per-stream preallocated pools.
+
+enum class StreamKind
+{
+    Video,
+    Audio,
+    Subtitles
+};
+
+struct Packet
+{
+    int64_t ptsUs;          // presentation time relative to playback start
+    uint32_t size;
+    bool endOfStream;
+};
+
+struct Frame
+{
+    int64_t ptsUs = 0;
+    bool endOfStream = false;
+    std::vector<uint8_t> data;   // preallocated, never resized while playing
+    size_t size = 0;
+};
+
+// Bounded lock-free ring for exactly one producer and one consumer thread.
+template<class T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity) : mItems(RoundUpToPowerOfTwo(capacity)), mMask(mItems.size() - 1) {}
+
+    bool TryPush(const T& item)
+    {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        if(tail - mHead.load(std::memory_order_acquire) == mItems.size())
+        {
+            return false;
+        }
+        mItems[tail & mMask] = item;
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! \brief: Pushes, yielding while the ring is full (back-pressure on the producer).
+    void Push(const T& item)
+    {
+        while(!TryPush(item))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    //! \returns: pointer to the oldest item without consuming it, nullptr when empty.
+    const T* Peek() const
+    {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if(head == mTail.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        return &mItems[head & mMask];
+    }
+
+    bool TryPop(T& item)
+    {
+        const T* front = Peek();
+        if(!front)
+        {
+            return false;
+        }
+        item = *front;
+        mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t Size() const
+    {
+        return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const { return mItems.size(); }
+
+private:
+    static size_t RoundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 1;
+        while(result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    std::vector<T> mItems;
+    const size_t mMask;
+    alignas(64) std::atomic<size_t> mHead{0};
+    alignas(64) std::atomic<size_t> mTail{0};
+};
+
+// Playback clock shared by all stages, started once by the presenter.
+class MasterClock
+{
+public:
+    void Start() { mStart = std::chrono::steady_clock::now(); }
+
+    int64_t NowUs() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - mStart).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point mStart;
+};
+
+void SpinFor(std::chrono::microseconds duration)
+{
+    auto until = std::chrono::steady_clock::now() + duration;
+    while(std::chrono::steady_clock::now() < until)
+    {
+    }
+}
+
+// Turns a packet into a frame: copies a synthetic payload and pays the decode cost.
+void DecodeInto(const Packet& packet, Frame& frame, std::chrono::microseconds decodeCost, uint8_t pattern)
+{
+    frame.ptsUs = packet.ptsUs;
+    frame.endOfStream = packet.endOfStream;
+    frame.size = std::min<size_t>(packet.size, frame.data.size());
+    std::fill_n(frame.data.begin(), frame.size, pattern);
+    SpinFor(decodeCost);
+}
+
+// Media input
+//
+// Local files are memory-mapped with sequential readahead and handed to the subsystems as
+// ByteSpan views straight into the mapping, so no byte is copied on the way. Input that
+// cannot be mapped (pipes, stdin) is read into buffers taken from a reusable ChunkPool.
+
+//! \brief: Non-owning view of contiguous bytes (std::span<const uint8_t> before C++20).
+struct ByteSpan
+{
+    const uint8_t* data;
+    size_t size;
+};
+
+// Fixed set of equally sized buffers that are recycled instead of reallocated.
+class ChunkPool
+{
+public:
+    explicit ChunkPool(size_t chunkSize = 1 << 20, size_t chunks = 4) : mChunkSize(chunkSize)
+    {
+        for(size_t i = 0; i < chunks; ++i)
+        {
+            mStorage.emplace_back(new uint8_t[chunkSize]);
+            mFree.push_back(mStorage.back().get());
+        }
+    }
+
+    size_t chunkSize() const { return mChunkSize; }
+
+    uint8_t* Acquire()
+    {
+        if(mFree.empty())
+        {
+            throw std::runtime_error("ChunkPool exhausted");
+        }
+        uint8_t* chunk = mFree.back();
+        mFree.pop_back();
+        return chunk;
+    }
+
+    void Release(uint8_t* chunk)
+    {
+        mFree.push_back(chunk);
+    }
+
+private:
+    size_t mChunkSize;
+    std::vector<std::unique_ptr<uint8_t[]>> mStorage;
+    std::vector<uint8_t*> mFree;
+};
+
+class MediaSource
+{
+public:
+    enum class Mode
+    {
+        Auto,   // mmap regular files, read() everything else
+        Read    // always read() into pooled chunks
+    };
+
+    //! \brief: Opens `path`, "-" means stdin. Throws std::system_error on failure.
+    explicit MediaSource(const std::string& path, Mode mode = Mode::Auto)
+    {
+        if(path == "-")
+        {
+            mFd = STDIN_FILENO;
+        }
+        else
+        {
+            mFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(mFd < 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "open " + path);
+            }
+            mOwnsFd = true;
+        }
+
+        struct stat info{};
+        if(mode == Mode::Auto && ::fstat(mFd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, mFd, 0);
+            if(mapping != MAP_FAILED)
+            {
+                ::madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+                mMapping = static_cast<const uint8_t*>(mapping);
+                mMappingSize = static_cast<size_t>(info.st_size);
+            }
+        }
+    }
+
+    //! \brief: Reads from an already open descriptor (e.g. a pipe), which stays open.
+    explicit MediaSource(int fd) : mFd(fd) {}
+
+    MediaSource(const MediaSource&) = delete;
+    MediaSource& operator=(const MediaSource&) = delete;
+
+    ~MediaSource()
+    {
+        if(mMapping)
+        {
+            ::munmap(const_cast<uint8_t*>(mMapping), mMappingSize);
+        }
+        if(mOwnsFd)
+        {
+            ::close(mFd);
+        }
+    }
+
+    bool mapped() const { return mMapping != nullptr; }
+
+    //! \brief: Calls `sink(ByteSpan)` with consecutive views covering the whole input.
+    //!         Views are only valid during the call.
+    //! \returns: number of bytes delivered.
+    template<class Sink>
+    size_t Stream(ChunkPool& pool, Sink&& sink)
+    {
+        if(mMapping)
+        {
+            for(size_t offset = 0; offset < mMappingSize; offset += pool.chunkSize())
+            {
+                sink(ByteSpan{mMapping + offset, std::min(pool.chunkSize(), mMappingSize - offset)});
+            }
+            return mMappingSize;
+        }
+
+        uint8_t* chunk = pool.Acquire();
+        size_t total = 0;
+        for(;;)
+        {
+            ssize_t count = ::read(mFd, chunk, pool.chunkSize());
+            if(count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(count <= 0)
+            {
+                pool.Release(chunk);
+                if(count < 0)
+                {
+                    throw std::system_error(errno, std::generic_category(), "read");
+                }
+                return total;
+            }
+            sink(ByteSpan{chunk, static_cast<size_t>(count)});
+            total += static_cast<size_t>(count);
+        }
+    }
+
+private:
+    int mFd = -1;
+    bool mOwnsFd = false;
+    const uint8_t* mMapping = nullptr;
+    size_t mMappingSize = 0;
+};
+
+//! \brief: Folds every byte of the view into `checksum`, the stand-in for real decoding.
+uint64_t Digest(ByteSpan bytes, uint64_t checksum)
+{
+    size_t i = 0;
+    for(; i + 8 <= bytes.size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes.data + i, 8);
+        checksum = (checksum ^ word) * 0x100000001b3ull;
+    }
+    for(; i < bytes.size; ++i)
+    {
+        checksum = (checksum ^ bytes.data[i]) * 0x100000001b3ull;
+    }
+    return checksum;
+}
 
 // Video Player Subsystem
 class VideoPlayer 
 {
 public:
+    explicit VideoPlayer(InitCost initCost = InitCost{0}) : mInitCost(initCost) {}
+
     void initialize() 
     {
-        std::cout << "Video Player initialized" << std::endl;
+        TRACE_SPAN("VideoPlayer::initialize");
+        SimulateWork(mInitCost);
+        std::cout << "Video Player initialized\n";
     }
 
     void playVideo(const std::string& video) 
     {
         std::cout << "Playing video: " << video << std::endl;
     }
+
+    void decode(const Packet& packet, Frame& frame, std::chrono::microseconds cost)
+    {
+        TRACE_SPAN("VideoPlayer::decode");
+        DecodeInto(packet, frame, cost, 'V');
+    }
+
+    uint64_t playVideo(ByteSpan video, uint64_t checksum)
+    {
+        return Digest(video, checksum);
+    }
+
+private:
+    InitCost mInitCost;
 };
 
 // Audio Player Subsystem
 class AudioPlayer 
 {
 public:
+    explicit AudioPlayer(InitCost initCost = InitCost{0}) : mInitCost(initCost) {}
+
     void initialize() 
     {
-        std::cout << "Audio Player initialized" << std::endl;
+        TRACE_SPAN("AudioPlayer::initialize");
+        SimulateWork(mInitCost);
+        std::cout << "Audio Player initialized\n";
     }
 
     void playAudio(const std::string& audio) 
     {
         std::cout << "Playing audio: " << audio << std::endl;
     }
+
+    void decode(const Packet& packet, Frame& frame, std::chrono::microseconds cost)
+    {
+        TRACE_SPAN("AudioPlayer::decode");
+        DecodeInto(packet, frame, cost, 'A');
+    }
+
+    uint64_t playAudio(ByteSpan audio, uint64_t checksum)
+    {
+        return Digest(audio, checksum);
+    }
+
+private:
+    InitCost mInitCost;
 };
 
 // Subtitles Subsystem
 class Subtitles 
 {
 public:
+    explicit Subtitles(InitCost initCost = InitCost{0}) : mInitCost(initCost) {}
+
     void initialize() 
     {
-        std::cout << "Subtitles initialized" << std::endl;
+        TRACE_SPAN("Subtitles::initialize");
+        SimulateWork(mInitCost);
+        std::cout << "Subtitles initialized\n";
     }
 
     void displaySubtitles(const std::string& subtitle) 
     {
         std::cout << "Displaying subtitles: " << subtitle << std::endl;
     }
+
+    void decode(const Packet& packet, Frame& frame, std::chrono::microseconds cost)
+    {
+        TRACE_SPAN("Subtitles::decode");
+        DecodeInto(packet, frame, cost, 'S');
+    }
+
+    uint64_t displaySubtitles(ByteSpan subtitle, uint64_t checksum)
+    {
+        return Digest(subtitle, checksum);
+    }
+
+private:
+    InitCost mInitCost;
 };
 
-// Multimedia Facade
-class MultimediaFacade 
+// Synthetic, in-memory media description used to drive the playback pipeline.
+struct SyntheticMedia
+{
+    struct Stream
+    {
+        double framesPerSecond;
+        uint32_t frameBytes;
+        std::chrono::microseconds decodeCost;
+    };
+
+    std::chrono::milliseconds duration{1000};
+    Stream video{60.0, 64 * 1024, std::chrono::microseconds(2000)};
+    Stream audio{50.0, 4 * 1024, std::chrono::microseconds(200)};
+    Stream subtitles{2.0, 128, std::chrono::microseconds(50)};
+};
+
+struct PlaybackStats
+{
+    struct Stream
+    {
+        uint64_t presented = 0;
+        uint64_t dropped = 0;
+        double averageQueueDepth = 0.0;
+        size_t maxQueueDepth = 0;
+        double averageDriftUs = 0.0;    // |present time - pts| of presented frames
+        double maxDriftUs = 0.0;
+    };
+
+    Stream video;
+    Stream audio;
+    Stream subtitles;
+    double seconds = 0.0;
+};
+
+// Demux -> decode -> present pipeline behind MultimediaFacade.
+class PlaybackEngine
 {
+public:
+    // Frames later than this are dropped instead of being decoded or presented.
+    static constexpr int64_t kLateThresholdUs = 20000;
+
+    using FrameObserver = std::function<void(StreamKind, const Frame&)>;
+
+    PlaybackEngine(VideoPlayer& video, AudioPlayer& audio, Subtitles& subtitles, const SyntheticMedia& media)
+        : mMedia(media),
+          mVideo(StreamKind::Video, media.video, [&video](const Packet& p, Frame& f, std::chrono::microseconds cost) { video.decode(p, f, cost); }),
+          mAudio(StreamKind::Audio, media.audio, [&audio](const Packet& p, Frame& f, std::chrono::microseconds cost) { audio.decode(p, f, cost); }),
+          mSubtitles(StreamKind::Subtitles, media.subtitles, [&subtitles](const Packet& p, Frame& f, std::chrono::microseconds cost) { subtitles.decode(p, f, cost); })
+    {
+    }
+
+    //! \brief: Called on the presenting thread with every presented frame, before it is recycled.
+    void onPresent(FrameObserver observer)
+    {
+        mOnPresent = std::move(observer);
+    }
+
+    PlaybackStats Run()
+    {
+        mClock.Start();
+
+        std::thread demux([this] { Demux(); });
+        std::thread videoDecoder([this] { Decode(mVideo); });
+        std::thread audioDecoder([this] { Decode(mAudio); });
+        std::thread subtitlesDecoder([this] { Decode(mSubtitles); });
+
+        PlaybackStats stats;
+        Present(stats);
+
+        demux.join();
+        videoDecoder.join();
+        audioDecoder.join();
+        subtitlesDecoder.join();
+
+        stats.seconds = mClock.NowUs() / 1e6;
+        return stats;
+    }
+
 private:
-    VideoPlayer videoPlayer;
-    AudioPlayer audioPlayer;
-    Subtitles subtitles;
+    static constexpr size_t kPacketQueueDepth = 64;
+    static constexpr size_t kFrameQueueDepth = 8;
+
+    using Decoder = std::function<void(const Packet&, Frame&, std::chrono::microseconds)>;
 
+    struct Lane
+    {
+        Lane(StreamKind streamKind, const SyntheticMedia::Stream& stream, Decoder decoder)
+            : kind(streamKind), config(stream), decode(std::move(decoder)), packets(kPacketQueueDepth),
+              frames(kFrameQueueDepth), freeFrames(kFrameQueueDepth + 1), pool(kFrameQueueDepth + 1)
+        {
+            for(auto& frame : pool)
+            {
+                frame.data.resize(stream.frameBytes);
+                freeFrames.TryPush(&frame);
+            }
+        }
+
+        StreamKind kind;
+        SyntheticMedia::Stream config;
+        Decoder decode;
+        SpscRing<Packet> packets;       // demux -> decoder
+        SpscRing<Frame*> frames;        // decoder -> presenter
+        SpscRing<Frame*> freeFrames;    // presenter -> decoder
+        std::vector<Frame> pool;
+        std::atomic<uint64_t> skipped{0};
+        bool finished = false;          // presenter only
+    };
+
+    // Interleaves the three streams by pts, as a container demuxer would.
+    void Demux()
+    {
+        const int64_t durationUs = std::chrono::duration_cast<std::chrono::microseconds>(mMedia.duration).count();
+        Lane* lanes[] = {&mVideo, &mAudio, &mSubtitles};
+        uint64_t emitted[] = {0, 0, 0};
+        bool ended[] = {false, false, false};
+
+        for(;;)
+        {
+            int next = -1;
+            int64_t nextPts = 0;
+            for(int i = 0; i < 3; ++i)
+            {
+                if(ended[i])
+                {
+                    continue;
+                }
+                int64_t pts = static_cast<int64_t>(emitted[i] * 1e6 / lanes[i]->config.framesPerSecond);
+                if(next < 0 || pts < nextPts)
+                {
+                    next = i;
+                    nextPts = pts;
+                }
+            }
+            if(next < 0)
+            {
+                return;
+            }
+
+            bool endOfStream = nextPts >= durationUs;
+            lanes[next]->packets.Push(Packet{nextPts, lanes[next]->config.frameBytes, endOfStream});
+            ended[next] = endOfStream;
+            ++emitted[next];
+        }
+    }
+
+    void Decode(Lane& lane)
+    {
+        for(;;)
+        {
+            Packet packet;
+            if(!lane.packets.TryPop(packet))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Skip decoding work for packets that would be too late once decoded.
+            int64_t readyUs = mClock.NowUs() + lane.config.decodeCost.count();
+            if(!packet.endOfStream && readyUs - packet.ptsUs > kLateThresholdUs)
+            {
+                lane.skipped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            Frame* frame = nullptr;
+            while(!lane.freeFrames.TryPop(frame))
+            {
+                std::this_thread::yield();
+            }
+            lane.decode(packet, *frame, lane.config.decodeCost);
+            lane.frames.Push(frame);
+
+            if(packet.endOfStream)
+            {
+                return;
+            }
+        }
+    }
+
+    void Present(PlaybackStats& stats)
+    {
+        std::pair<Lane*, PlaybackStats::Stream*> lanes[] = {
+            {&mVideo, &stats.video}, {&mAudio, &stats.audio}, {&mSubtitles, &stats.subtitles}};
+        uint64_t samples = 0;
+        double depthSum[3] = {0, 0, 0};
+        double driftSum[3] = {0, 0, 0};
+
+        while(!(mVideo.finished && mAudio.finished && mSubtitles.finished))
+        {
+            int64_t now = mClock.NowUs();
+            int64_t wakeUp = now + 1000;
+
+            ++samples;
+            for(int i = 0; i < 3; ++i)
+            {
+                auto& [lane, out] = lanes[i];
+                size_t depth = lane->frames.Size();
+                depthSum[i] += depth;
+                out->maxQueueDepth = std::max(out->maxQueueDepth, depth);
+
+                while(Frame* const* front = lane->frames.Peek())
+                {
+                    Frame* frame = *front;
+                    if(frame->endOfStream)
+                    {
+                        lane->finished = true;
+                    }
+                    else if(frame->ptsUs > now)
+                    {
+                        wakeUp = std::min(wakeUp, frame->ptsUs);
+                        break;
+                    }
+                    else if(now - frame->ptsUs > kLateThresholdUs)
+                    {
+                        ++out->dropped;
+                    }
+                    else
+                    {
+                        double drift = static_cast<double>(now - frame->ptsUs);
+                        driftSum[i] += drift;
+                        out->maxDriftUs = std::max(out->maxDriftUs, drift);
+                        ++out->presented;
+                        if(mOnPresent)
+                        {
+                            mOnPresent(lane->kind, *frame);
+                        }
+                    }
+                    lane->frames.TryPop(frame);
+                    lane->freeFrames.Push(frame);
+                }
+            }
+
+            int64_t sleepUs = wakeUp - mClock.NowUs();
+            if(sleepUs > 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+            }
+        }
+
+        for(int i = 0; i < 3; ++i)
+        {
+            auto& [lane, out] = lanes[i];
+            out->dropped += lane->skipped.load();
+            out->averageQueueDepth = samples ? depthSum[i] / samples : 0.0;
+            out->averageDriftUs = out->presented ? driftSum[i] / out->presented : 0.0;
+        }
+    }
+
+    SyntheticMedia mMedia;
+    FrameObserver mOnPresent;
+    MasterClock mClock;
+    Lane mVideo;
+    Lane mAudio;
+    Lane mSubtitles;
+};
+
+// Dependency aware initialization graph.
+//
+// Every step starts as soon as the steps it depends on are done. In serial mode the steps
+// run one after another, in the order they were added, on the caller's thread.
+class InitGraph
+{
 public:
-    void initializeSystem() 
+    using StepId = size_t;
+
+    StepId Add(std::string name, std::function<void()> init, std::vector<StepId> dependencies = {})
     {
-        videoPlayer.initialize();
-        audioPlayer.initialize();
-        subtitles.initialize();
+        mSteps.push_back(Step{std::move(name), std::move(init), std::move(dependencies), 0.0});
+        return mSteps.size() - 1;
+    }
+
+    //! \returns: future that becomes ready once every step has finished.
+    std::shared_future<void> Run(bool parallel)
+    {
+        std::vector<std::shared_future<void>> done;
+        for(StepId id = 0; id < mSteps.size(); ++id)
+        {
+            std::vector<std::shared_future<void>> dependencies;
+            for(StepId dependency : mSteps[id].dependencies)
+            {
+                dependencies.push_back(done[dependency]);
+            }
+
+            auto task = [this, id, dependencies] {
+                for(auto& dependency : dependencies)
+                {
+                    dependency.wait();
+                }
+                auto start = std::chrono::steady_clock::now();
+                mSteps[id].init();
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                mSteps[id].milliseconds = elapsed.count();
+            };
+
+            done.push_back(std::async(parallel ? std::launch::async : std::launch::deferred, task).share());
+            if(!parallel)
+            {
+                done.back().wait();
+            }
+        }
+
+        return std::async(std::launch::deferred, [done] {
+            for(auto& step : done)
+            {
+                step.wait();
+            }
+        }).share();
+    }
+
+    //! \brief: Time spent in each step's init, valid once the step has finished.
+    std::vector<std::pair<std::string, double>> Timings() const
+    {
+        std::vector<std::pair<std::string, double>> timings;
+        for(const auto& step : mSteps)
+        {
+            timings.emplace_back(step.name, step.milliseconds);
+        }
+        return timings;
+    }
+
+private:
+    struct Step
+    {
+        std::string name;
+        std::function<void()> init;
+        std::vector<StepId> dependencies;
+        double milliseconds;
+    };
+
+    std::vector<Step> mSteps;
+};
+
+// Multimedia Facade
+class MultimediaFacade 
+{
+public:
+    enum class InitMode
+    {
+        Serial,     // one subsystem after another on the caller's thread
+        Parallel,   // independent subsystems concurrently
+        Lazy        // like Parallel, but subtitles are initialized on first use
+    };
+
+    MultimediaFacade() = default;
+
+    MultimediaFacade(InitCost videoCost, InitCost audioCost, InitCost subtitlesCost)
+        : videoPlayer(videoCost), audioPlayer(audioCost), subtitles(subtitlesCost) {}
+
+    //! \returns: future that is ready once all eagerly initialized subsystems are up. Only the
+    //!           first call initializes, later ones return the same future whatever their mode.
+    std::shared_future<void> initializeSystem(InitMode mode = InitMode::Serial) 
+    {
+        TRACE_SPAN("MultimediaFacade::initializeSystem");
+        if(mReady.valid())
+        {
+            return mReady;
+        }
+
+        // Subtitles are rendered on top of the video output, so they wait for the video player.
+        auto video = mInitGraph.Add("video", [this] { videoPlayer.initialize(); });
+        mInitGraph.Add("audio", [this] { audioPlayer.initialize(); });
+
+        if(mode == InitMode::Lazy)
+        {
+            mSubtitlesDeferred = true;
+        }
+        else
+        {
+            mInitGraph.Add("subtitles", [this] { subtitles.initialize(); }, {video});
+        }
+
+        mReady = mInitGraph.Run(mode != InitMode::Serial);
+        return mReady;
     }
 
     void playMultimedia(const std::string& video, const std::string& audio, const std::string& subtitle) 
     {
+        TRACE_SPAN("MultimediaFacade::playMultimedia");
+        if(mReady.valid())
+        {
+            mReady.wait();
+        }
         videoPlayer.playVideo(video);
         audioPlayer.playAudio(audio);
+        ensureSubtitles();
         subtitles.displaySubtitles(subtitle);
     }
+
+    struct MediaInputStats
+    {
+        size_t bytes = 0;
+        uint64_t checksum = 0;
+    };
+
+    //! \brief: Streams opened media sources to the subsystems as views into their input.
+    MediaInputStats playMultimedia(MediaSource& video, MediaSource& audio, MediaSource& subtitle)
+    {
+        TRACE_SPAN("MultimediaFacade::playMultimedia(files)");
+        if(mReady.valid())
+        {
+            mReady.wait();
+        }
+        ensureSubtitles();
+
+        MediaInputStats stats;
+        stats.bytes += video.Stream(mChunkPool, [&](ByteSpan bytes) { stats.checksum = videoPlayer.playVideo(bytes, stats.checksum); });
+        stats.bytes += audio.Stream(mChunkPool, [&](ByteSpan bytes) { stats.checksum = audioPlayer.playAudio(bytes, stats.checksum); });
+        stats.bytes += subtitle.Stream(mChunkPool, [&](ByteSpan bytes) { stats.checksum = subtitles.displaySubtitles(bytes, stats.checksum); });
+        return stats;
+    }
+
+    //! \brief: Plays synthetic streams through the concurrent demux/decode/present pipeline.
+    PlaybackStats playMultimedia(const SyntheticMedia& media)
+    {
+        TRACE_SPAN("MultimediaFacade::playMultimedia(synthetic)");
+        if(mReady.valid())
+        {
+            mReady.wait();
+        }
+        ensureSubtitles();
+        PlaybackEngine engine(videoPlayer, audioPlayer, subtitles, media);
+        return engine.Run();
+    }
+
+    //! \brief: Per-subsystem init time in milliseconds, including lazily initialized ones.
+    std::vector<std::pair<std::string, double>> initTimings() const
+    {
+        auto timings = mInitGraph.Timings();
+        if(mSubtitlesDeferred)
+        {
+            timings.emplace_back("subtitles (lazy)", mLazySubtitlesMs);
+        }
+        return timings;
+    }
+
+private:
+    void ensureSubtitles()
+    {
+        if(!mSubtitlesDeferred)
+        {
+            return;
+        }
+        std::call_once(mSubtitlesOnce, [this] {
+            TRACE_SPAN("MultimediaFacade::ensureSubtitles");
+            auto start = std::chrono::steady_clock::now();
+            subtitles.initialize();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            mLazySubtitlesMs = elapsed.count();
+        });
+    }
+
+    VideoPlayer videoPlayer;
+    AudioPlayer audioPlayer;
+    Subtitles subtitles;
+
+    ChunkPool mChunkPool;
+    InitGraph mInitGraph;
+    std::shared_future<void> mReady;
+    bool mSubtitlesDeferred = false;
+    std::once_flag mSubtitlesOnce;
+    double mLazySubtitlesMs = 0.0;
 };
 
-int main() 
+int main(int argc, char* argv[]) 
 {
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return RunChecks();
+    }
+
+    TRACE_SESSION("facade.trace.json");
+
+    // ./app --play <video> <audio> <subtitles>, "-" reads from stdin
+    if(argc > 4 && std::string(argv[1]) == "--play")
+    {
+        MultimediaFacade multimedia;
+        multimedia.initializeSystem();
+
+        MediaSource video(argv[2]);
+        MediaSource audio(argv[3]);
+        MediaSource subtitle(argv[4]);
+        auto stats = multimedia.playMultimedia(video, audio, subtitle);
+        std::cout << "Played " << stats.bytes << " bytes, checksum " << stats.checksum << std::endl;
+        return 0;
+    }
+
     MultimediaFacade multimedia;
     multimedia.initializeSystem();
     multimedia.playMultimedia("Movie.mp4", "Soundtrack.mp3", "English Subtitles");
 
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+void NoteStream(const bench::Harness& harness, const char* name, const PlaybackStats::Stream& stream, double seconds)
+{
+    harness.note("%s: %.1f frames/s presented, %llu dropped, queue depth avg %.2f max %zu, drift avg %.0f us max %.0f us",
+                 name, stream.presented / seconds, static_cast<unsigned long long>(stream.dropped),
+                 stream.averageQueueDepth, stream.maxQueueDepth, stream.averageDriftUs, stream.maxDriftUs);
+}
+
+//! \brief: Serial, parallel and lazy startup with simulated subsystem costs, timed up to
+//!         the end of the first playback.
+void BenchmarkStartup(bench::Harness& harness)
+{
+    const InitCost video{12};
+    const InitCost audio{8};
+    const InitCost subtitles{6};
+
+    std::pair<const char*, MultimediaFacade::InitMode> modes[] = {
+        {"serial", MultimediaFacade::InitMode::Serial},
+        {"parallel", MultimediaFacade::InitMode::Parallel},
+        {"lazy", MultimediaFacade::InitMode::Lazy}};
+
+    for(auto& [name, mode] : modes)
+    {
+        double readyMs = 0.0;
+        harness.run(std::string("startup to first play, ") + name + " init", 1, [&, mode = mode] {
+            MultimediaFacade multimedia(video, audio, subtitles);
+            auto start = std::chrono::steady_clock::now();
+            multimedia.initializeSystem(mode).wait();
+            readyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            multimedia.playMultimedia("Movie.mp4", "Soundtrack.mp3", "English Subtitles");
+        });
+        harness.note("ready after %.1f ms (last rep)", readyMs);
+    }
+}
+
+void BenchmarkPlayback(bench::Harness& harness)
+{
+    SyntheticMedia light;
+    light.duration = std::chrono::milliseconds(100);
+
+    // Video decoding slower than its frame interval forces the pipeline to drop frames.
+    SyntheticMedia overloaded = light;
+    overloaded.video.decodeCost = std::chrono::microseconds(25000);
+
+    MultimediaFacade multimedia;
+    multimedia.initializeSystem().wait();
+
+    std::pair<const char*, SyntheticMedia> scenarios[] = {
+        {"playback, 100 ms", light}, {"playback, overloaded video decode", overloaded}};
+    for(auto& [name, media] : scenarios)
+    {
+        PlaybackStats stats;
+        harness.run(name, 1, [&, &media = media] { stats = multimedia.playMultimedia(media); });
+        NoteStream(harness, "video", stats.video, stats.seconds);
+        NoteStream(harness, "audio", stats.audio, stats.seconds);
+        NoteStream(harness, "subtitles", stats.subtitles, stats.seconds);
+    }
+}
+
+//! \brief: Plays a generated file through mmap (MADV_SEQUENTIAL), read() into pooled chunks
+//!         and a pipe, each from a warm page cache and from a cold one: the cold cases drop
+//!         the file from the page cache before every repetition, so it is read from disk.
+void BenchmarkFileInput(bench::Harness& harness, size_t inputMiB)
+{
+    char path[] = "/tmp/facade_input_XXXXXX";
+    int fd = ::mkstemp(path);
+    if(fd < 0)
+    {
+        std::fprintf(stderr, "facade: cannot create benchmark input file\n");
+        return;
+    }
+
+    std::vector<uint8_t> block(1 << 20);
+    for(size_t i = 0; i < block.size(); ++i)
+    {
+        block[i] = static_cast<uint8_t>(i * 131);
+    }
+    for(size_t i = 0; i < inputMiB; ++i)
+    {
+        if(::write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size()))
+        {
+            std::fprintf(stderr, "facade: cannot write benchmark input file\n");
+            ::close(fd);
+            ::unlink(path);
+            return;
+        }
+    }
+    // Written back, so the cold cases can evict the pages.
+    ::fdatasync(fd);
+
+    MultimediaFacade multimedia;
+    multimedia.initializeSystem().wait();
+
+    auto playFile = [&](MediaSource::Mode mode) {
+        return [&path, &multimedia, mode] {
+            MediaSource video(path, mode);
+            MediaSource audio("/dev/null");
+            MediaSource subtitle("/dev/null");
+            return multimedia.playMultimedia(video, audio, subtitle);
+        };
+    };
+    auto playPipe = [&path, &multimedia] {
+        FILE* pipe = ::popen((std::string("cat ") + path).c_str(), "r");
+        if(!pipe)
+        {
+            throw std::system_error(errno, std::generic_category(), "popen");
+        }
+        MediaSource video(::fileno(pipe));
+        MediaSource audio("/dev/null");
+        MediaSource subtitle("/dev/null");
+        auto stats = multimedia.playMultimedia(video, audio, subtitle);
+        ::pclose(pipe);
+        return stats;
+    };
+
+    std::pair<const char*, std::function<MultimediaFacade::MediaInputStats()>> inputs[] = {
+        {"mmap", playFile(MediaSource::Mode::Auto)},
+        {"read()", playFile(MediaSource::Mode::Read)},
+        {"pipe", playPipe}};
+
+    for(bool cold : {false, true})
+    {
+        for(auto& [input, play] : inputs)
+        {
+            std::string name = std::string("file input, ") + input + (cold ? ", cold" : ", warm") + ", per byte";
+            long minorFaults = 0;
+            long majorFaults = 0;
+            size_t plays = 0;
+            uint64_t checksum = 0;
+            try
+            {
+                harness.run(name, inputMiB << 20, [&, &play = play] {
+                    if(cold)
+                    {
+                        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                    }
+                    rusage before{};
+                    ::getrusage(RUSAGE_SELF, &before);
+                    checksum = play().checksum;
+                    rusage after{};
+                    ::getrusage(RUSAGE_SELF, &after);
+                    minorFaults += after.ru_minflt - before.ru_minflt;
+                    majorFaults += after.ru_majflt - before.ru_majflt;
+                    ++plays;
+                });
+            }
+            catch(const std::exception& error)
+            {
+                std::fprintf(stderr, "facade: %s skipped: %s\n", name.c_str(), error.what());
+                continue;
+            }
+            harness.note("%zu MiB, %.0f minor / %.0f major page faults per play (checksum %llu)", inputMiB,
+                         static_cast<double>(minorFaults) / std::max<size_t>(plays, 1),
+                         static_cast<double>(majorFaults) / std::max<size_t>(plays, 1),
+                         static_cast<unsigned long long>(checksum));
+        }
+    }
+
+    ::close(fd);
+    ::unlink(path);
+}
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("facade", argc, argv);
+    bench::MuteStdout mute;
+
+    const size_t startups = 20;
+    harness.run("startup, parallel init graph", startups, [&] {
+        for(size_t i = 0; i < startups; ++i)
+        {
+            MultimediaFacade multimedia;
+            multimedia.initializeSystem(MultimediaFacade::InitMode::Parallel).wait();
+        }
+    });
+
+    const size_t plays = 1000;
+    MultimediaFacade multimedia;
+    multimedia.initializeSystem().wait();
+    harness.run("play through facade", plays, [&] {
+        for(size_t i = 0; i < plays; ++i)
+        {
+            multimedia.playMultimedia("Movie.mp4", "Soundtrack.mp3", "English Subtitles");
+        }
+    });
+
+    std::vector<uint8_t> input(1 << 20);
+    for(size_t i = 0; i < input.size(); ++i)
+    {
+        input[i] = static_cast<uint8_t>(i * 131);
+    }
+    VideoPlayer videoPlayer;
+    harness.run("digest input view, per byte", input.size(), [&] {
+        bench::DoNotOptimize(videoPlayer.playVideo(ByteSpan{input.data(), input.size()}, 0));
+    });
+
+    BenchmarkStartup(harness);
+    BenchmarkPlayback(harness);
+    // A 64 MiB file by default, `--scale 64` plays a 4 GiB one.
+    BenchmarkFileInput(harness, harness.scaled(64));
+}
+
+///////////////////////////// Checks ////////////////////////////////////
+
+//! \brief: Runs a diamond (parse -> video, audio -> mix) plus an independent step and checks
+//!         that every step runs exactly once and only after all of its dependencies.
+void CheckInitGraphOrder(bool parallel)
+{
+    std::mutex mutex;
+    std::vector<InitGraph::StepId> order;
+    InitGraph graph;
+    auto record = [&](InitGraph::StepId id) {
+        return [&, id] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(id);
+        };
+    };
+
+    std::vector<std::vector<InitGraph::StepId>> dependencies = {{}, {0}, {0}, {1, 2}, {}};
+    const char* names[] = {"parse", "video", "audio", "mix", "log"};
+    for(InitGraph::StepId id = 0; id < dependencies.size(); ++id)
+    {
+        CHECK(graph.Add(names[id], record(id), dependencies[id]) == id);
+    }
+    graph.Run(parallel).wait();
+
+    std::vector<size_t> runs(dependencies.size(), 0);
+    std::vector<size_t> position(dependencies.size(), 0);
+    for(size_t i = 0; i < order.size(); ++i)
+    {
+        ++runs[order[i]];
+        position[order[i]] = i;
+    }
+    CHECK(order.size() == dependencies.size());
+    CHECK(std::all_of(runs.begin(), runs.end(), [](size_t count) { return count == 1; }));
+
+    bool dependenciesFirst = true;
+    for(InitGraph::StepId id = 0; id < dependencies.size(); ++id)
+    {
+        for(InitGraph::StepId dependency : dependencies[id])
+        {
+            dependenciesFirst = dependenciesFirst && position[dependency] < position[id];
+        }
+    }
+    CHECK(dependenciesFirst);
+
+    if(!parallel)
+    {
+        CHECK((order == std::vector<InitGraph::StepId>{0, 1, 2, 3, 4}));
+    }
+}
+
+size_t CountLines(const std::string& text, const std::string& line)
+{
+    size_t count = 0;
+    for(size_t at = text.find(line); at != std::string::npos; at = text.find(line, at + line.size()))
+    {
+        ++count;
+    }
+    return count;
+}
+
+//! \brief: A second initializeSystem() must neither add the subsystems to the init graph
+//!         again nor initialize them twice.
+void CheckInitializeOnce(MultimediaFacade::InitMode mode)
+{
+    std::ostringstream output;
+    std::streambuf* previous = std::cout.rdbuf(output.rdbuf());
+    {
+        MultimediaFacade multimedia;
+        multimedia.initializeSystem(mode).wait();
+        multimedia.initializeSystem(mode).wait();
+        multimedia.initializeSystem(MultimediaFacade::InitMode::Serial).wait();
+        multimedia.playMultimedia("Movie.mp4", "Soundtrack.mp3", "English Subtitles");
+        CHECK(multimedia.initTimings().size() == 3);
+    }
+    std::cout.rdbuf(previous);
+
+    CHECK(CountLines(output.str(), "Video Player initialized") == 1);
+    CHECK(CountLines(output.str(), "Audio Player initialized") == 1);
+    CHECK(CountLines(output.str(), "Subtitles initialized") == 1);
+}
+
+//! \brief: Plays `media` through a PlaybackEngine and checks that every frame the demuxer
+//!         emits is either presented, in pts order and with its stream's payload, or counted
+//!         as dropped, and that Run() returns once all three streams have ended.
+//! \returns: frames dropped over all streams.
+uint64_t CheckPlayback(const SyntheticMedia& media)
+{
+    VideoPlayer videoPlayer;
+    AudioPlayer audioPlayer;
+    Subtitles subtitles;
+    PlaybackEngine engine(videoPlayer, audioPlayer, subtitles, media);
+
+    std::vector<int64_t> presented[3];
+    bool payloadsMatch = true;
+    engine.onPresent([&](StreamKind kind, const Frame& frame) {
+        static const uint8_t kPatterns[] = {'V', 'A', 'S'};
+        auto stream = static_cast<size_t>(kind);
+        presented[stream].push_back(frame.ptsUs);
+        payloadsMatch = payloadsMatch && frame.size > 0 && frame.data[0] == kPatterns[stream] &&
+                        frame.data[frame.size - 1] == kPatterns[stream];
+    });
+    PlaybackStats stats = engine.Run();
+    CHECK(payloadsMatch);
+
+    const int64_t durationUs = std::chrono::duration_cast<std::chrono::microseconds>(media.duration).count();
+    std::pair<const SyntheticMedia::Stream*, const PlaybackStats::Stream*> streams[] = {
+        {&media.video, &stats.video}, {&media.audio, &stats.audio}, {&media.subtitles, &stats.subtitles}};
+    uint64_t dropped = 0;
+    for(size_t i = 0; i < 3; ++i)
+    {
+        auto [config, out] = streams[i];
+
+        // The pts the demuxer emits before the end of stream packet.
+        std::vector<int64_t> emitted;
+        for(uint64_t frame = 0;; ++frame)
+        {
+            int64_t pts = static_cast<int64_t>(frame * 1e6 / config->framesPerSecond);
+            if(pts >= durationUs)
+            {
+                break;
+            }
+            emitted.push_back(pts);
+        }
+
+        CHECK(presented[i].size() == out->presented);
+        CHECK(out->presented + out->dropped == emitted.size());
+        CHECK(std::is_sorted(presented[i].begin(), presented[i].end(), std::less_equal<int64_t>()));
+        CHECK(std::includes(emitted.begin(), emitted.end(), presented[i].begin(), presented[i].end()));
+        dropped += out->dropped;
+    }
+    return dropped;
+}
+
+int RunChecks()
+{
+    CheckInitGraphOrder(false);
+    CheckInitGraphOrder(true);
+    CheckInitializeOnce(MultimediaFacade::InitMode::Serial);
+    CheckInitializeOnce(MultimediaFacade::InitMode::Parallel);
+    CheckInitializeOnce(MultimediaFacade::InitMode::Lazy);
+
+    SyntheticMedia light;
+    light.duration = std::chrono::milliseconds(200);
+    light.video = {100.0, 1024, std::chrono::microseconds(0)};
+    light.audio = {50.0, 256, std::chrono::microseconds(0)};
+    light.subtitles = {10.0, 32, std::chrono::microseconds(0)};
+    CHECK(CheckPlayback(light) == 0);
+
+    // Video decoding slower than its frame interval: frames are dropped, but still accounted
+    // for, and the end of stream still reaches the presenter.
+    SyntheticMedia overloaded = light;
+    overloaded.video.decodeCost = std::chrono::microseconds(25000);
+    CHECK(CheckPlayback(overloaded) > 0);
+    return check::Report("facade");
+}
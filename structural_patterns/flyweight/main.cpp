@@ -2,6 +2,10 @@
 #include <memory>
 #include <cstring>
 #include <unordered_map>
+#include <string>
+#include <vector>
+
+#include "../../benchmarks/bench.h"
 
 // Reference - https://refactoring.guru/design-patterns/flyweight
 
@@ -30,6 +34,8 @@
 // GunBullet::Draw() is calling Sprite::Draw()
 // GunBulletSprite::Draw()
 
+//! \brief: Times the example's hot paths with the shared harness. Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
 
 enum BulletTypes
 {
@@ -45,7 +51,7 @@ public:
 // Sprite is large object that each Game bullet has.
 // Since many bullets share few sprites, we don't need to have Sprite instance
 // in each bullet.
-class GunBulletSprite : public SpriteInterface
+class GunBulletSprite final : public SpriteInterface
 {
 private:
     static constexpr int BUFFER_SIZE = 1000;
@@ -83,7 +89,7 @@ public:
 
 };
 
-class GunBullet : public BulletInterface
+class GunBullet final : public BulletInterface
 {
 public:
     GunBullet(std::shared_ptr<SpriteInterface> sprite) : BulletInterface(sprite) {}
@@ -142,8 +148,14 @@ private:
 
 };
 
-int main()
+int main(int argc, char* argv[])
 {
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+
     BulletFactory bulletFactory;
 
     auto gunBullet1 = bulletFactory.CreateBullet(GUN_BULLET);
@@ -153,4 +165,31 @@ int main()
     gunBullet2->Draw();
 
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("flyweight", argc, argv);
+    bench::MuteStdout mute;
+
+    const size_t bullets = 1000;
+    BulletFactory bulletFactory;
+    std::vector<std::shared_ptr<BulletInterface>> magazine;
+    magazine.reserve(bullets);
+
+    harness.run("create bullet (shared sprite)", bullets, [&] {
+        magazine.clear();
+        for(size_t i = 0; i < bullets; ++i)
+        {
+            magazine.push_back(bulletFactory.CreateBullet(GUN_BULLET));
+        }
+    });
+    harness.run("draw bullet", bullets, [&] {
+        for(auto& bullet : magazine)
+        {
+            bullet->Draw();
+        }
+    });
+}
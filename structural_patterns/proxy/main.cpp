@@ -1,10 +1,40 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../../benchmarks/bench.h"
+#include "../../tests/check.h"
+#include "../../tracing/trace.h"
 
 // Proxy structural design patterns provides a surrogate or placeholder 
 // for another object to control access to it.
 //
 // For example: We create a log proxy object to debug all access to 
 // other class.
+//
+// The other proxies control when and how the backend is reached:
+//      LazyDataBaseProxy (virtual proxy) connects on the first Query instead of up front.
+//      LockingDataBaseProxy (protection proxy) lets threads share one backend, one at a time.
+//      PooledDataBase hands each caller one of N backends and makes it wait when all are busy.
+//
+// Built with `make trace` every Query is recorded as a trace span and the demo writes
+// proxy.trace.json (Chrome trace-event format).
+
+//! \brief: Times the example's hot paths with the shared harness. Run with `./bench_app --harness`.
+void RunHarness(int argc, char* argv[]);
+
+//! \brief: Runs the example's self-checks. Run with `./app --check`.
+int RunChecks();
 
 
 class DataBaseInterface
@@ -19,11 +49,35 @@ public:
     virtual ~DataBaseInterface() = default;
 };
 
-class DataBase : public DataBaseInterface
+// Simulated backend latencies, zero for the demo.
+struct BackendCost
+{
+    std::chrono::microseconds connect{0};   // paid once, when the backend is created
+    std::chrono::microseconds query{0};     // paid by every Query, the round trip to the server
+};
+
+void SimulateLatency(std::chrono::microseconds cost)
+{
+    if(cost.count() > 0)
+    {
+        std::this_thread::sleep_for(cost);
+    }
+}
+
+// One connection to the database. Like a real connection it serves one query at a time,
+// so threads must not share it without a LockingDataBaseProxy.
+class DataBase final : public DataBaseInterface
 {
 public:
-    std::string Query(std::string query) override
+    explicit DataBase(BackendCost cost = {}) : mCost(cost)
+    {
+        SimulateLatency(mCost.connect);
+    }
+
+    std::string Query(std::string /*query*/) override
     {
+        TRACE_SPAN("DataBase::Query");
+        SimulateLatency(mCost.query);
         return std::string{"query_result"};
     }
 
@@ -31,9 +85,12 @@ public:
     {
 
     }
+
+private:
+    BackendCost mCost;
 };
 
-class DataPaceLoggingProxy : public DataBaseInterface
+class DataPaceLoggingProxy final : public DataBaseInterface
 {
 public:
     DataPaceLoggingProxy(DataBaseInterface *db): mDb(db)
@@ -43,6 +100,7 @@ public:
 
     std::string Query(std::string query) override
     {
+        TRACE_SPAN("DataPaceLoggingProxy::Query");
         std::cout << "Query log: " << query << std::endl;
         return mDb->Query(query);
     }
@@ -56,9 +114,272 @@ private:
     DataBaseInterface *mDb;
 };
 
-int main()
+// Virtual proxy: the connection is only opened by the first Query, so creating the proxy
+// costs nothing and a backend that is never queried is never connected.
+class LazyDataBaseProxy final : public DataBaseInterface
+{
+public:
+    explicit LazyDataBaseProxy(BackendCost cost = {}) : mCost(cost) {}
+
+    std::string Query(std::string query) override
+    {
+        std::call_once(mConnectOnce, [this] {
+            mDb = std::make_unique<DataBase>(mCost);
+            mConnected.store(true, std::memory_order_release);
+        });
+        return mDb->Query(std::move(query));
+    }
+
+    bool connected() const { return mConnected.load(std::memory_order_acquire); }
+
+private:
+    BackendCost mCost;
+    std::once_flag mConnectOnce;
+    std::unique_ptr<DataBase> mDb;
+    std::atomic<bool> mConnected{false};
+};
+
+// Protection proxy: serializes concurrent callers on one backend.
+class LockingDataBaseProxy final : public DataBaseInterface
+{
+public:
+    explicit LockingDataBaseProxy(DataBaseInterface* db) : mDb(db) {}
+
+    std::string Query(std::string query) override
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mDb->Query(std::move(query));
+    }
+
+private:
+    DataBaseInterface* mDb;
+    std::mutex mMutex;
+};
+
+class PoolTimeout : public std::runtime_error
+{
+public:
+    PoolTimeout() : std::runtime_error("no database connection became free in time") {}
+};
+
+// N backends shared by any number of threads, each Query runs on a backend nobody else is
+// using. Free backends are kept on a lock-free stack, so taking and returning one is a
+// single CAS; only callers that find the pool empty block, until a backend is returned or
+// their wait timeout expires. The backends are lazy proxies and the stack hands out the
+// most recently returned one first, so only as many backends connect as callers ever
+// overlap.
+class PooledDataBase final : public DataBaseInterface
+{
+public:
+    struct Stats
+    {
+        uint64_t leases = 0;        // backends handed out
+        uint64_t waits = 0;         // acquisitions that found every backend busy
+        uint64_t timeouts = 0;      // acquisitions that gave up
+        size_t inUse = 0;
+        size_t peakInUse = 0;
+        size_t connected = 0;       // backends that opened their connection
+        double utilization = 0;     // busy backend time / (size * lifetime)
+    };
+
+    // A leased backend, returned to the pool when the lease goes away.
+    class Lease
+    {
+    public:
+        Lease() = default;
+        Lease(PooledDataBase* pool, uint32_t slot)
+            : mPool(pool), mSlot(slot), mStart(std::chrono::steady_clock::now()) {}
+        Lease(Lease&& other) noexcept
+            : mPool(std::exchange(other.mPool, nullptr)), mSlot(other.mSlot), mStart(other.mStart) {}
+        Lease& operator=(Lease&&) = delete;
+
+        ~Lease()
+        {
+            if(mPool)
+            {
+                mPool->Release(mSlot, mStart);
+            }
+        }
+
+        explicit operator bool() const { return mPool != nullptr; }
+        DataBaseInterface* operator->() const { return &mPool->mSlots[mSlot]->backend; }
+
+    private:
+        PooledDataBase* mPool = nullptr;
+        uint32_t mSlot = 0;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    //! \param waitTimeout: how long Query waits for a free backend before it throws PoolTimeout.
+    PooledDataBase(size_t size, BackendCost cost = {}, std::chrono::microseconds waitTimeout = std::chrono::seconds(1))
+        : mWaitTimeout(waitTimeout), mCreated(std::chrono::steady_clock::now())
+    {
+        mSlots.reserve(size);
+        for(size_t i = 0; i < size; ++i)
+        {
+            mSlots.push_back(std::make_unique<Slot>(cost));
+        }
+        for(size_t i = size; i-- > 0;)
+        {
+            Push(static_cast<uint32_t>(i));
+        }
+    }
+
+    //! \brief: Runs `query` on a free backend. Throws PoolTimeout if none frees up in time.
+    std::string Query(std::string query) override
+    {
+        Lease lease = Acquire(mWaitTimeout);
+        if(!lease)
+        {
+            throw PoolTimeout();
+        }
+        return lease->Query(std::move(query));
+    }
+
+    //! \returns: a free backend, or an empty lease if none became free within `timeout`.
+    Lease Acquire(std::chrono::microseconds timeout)
+    {
+        uint32_t slot = Pop();
+        if(slot == kNone)
+        {
+            mWaits.fetch_add(1, std::memory_order_relaxed);
+            slot = WaitForSlot(timeout);
+            if(slot == kNone)
+            {
+                mTimeouts.fetch_add(1, std::memory_order_relaxed);
+                return Lease();
+            }
+        }
+
+        mLeases.fetch_add(1, std::memory_order_relaxed);
+        size_t inUse = mInUse.fetch_add(1, std::memory_order_relaxed) + 1;
+        size_t peak = mPeakInUse.load(std::memory_order_relaxed);
+        while(inUse > peak && !mPeakInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed))
+        {
+        }
+        return Lease(this, slot);
+    }
+
+    Stats stats() const
+    {
+        Stats stats;
+        stats.leases = mLeases.load(std::memory_order_relaxed);
+        stats.waits = mWaits.load(std::memory_order_relaxed);
+        stats.timeouts = mTimeouts.load(std::memory_order_relaxed);
+        stats.inUse = mInUse.load(std::memory_order_relaxed);
+        stats.peakInUse = mPeakInUse.load(std::memory_order_relaxed);
+        for(auto& slot : mSlots)
+        {
+            stats.connected += slot->backend.connected();
+        }
+        std::chrono::duration<double, std::nano> lifetime = std::chrono::steady_clock::now() - mCreated;
+        stats.utilization = mBusyNs.load(std::memory_order_relaxed) / (lifetime.count() * mSlots.size());
+        return stats;
+    }
+
+    size_t size() const { return mSlots.size(); }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Slot
+    {
+        explicit Slot(BackendCost cost) : backend(cost) {}
+
+        LazyDataBaseProxy backend;
+        std::atomic<uint32_t> next{kNone};
+    };
+
+    // The stack head packs the top slot with a counter bumped by every push and pop, so a
+    // pop that raced with a pop and push of the same slot fails its CAS (ABA).
+    static uint64_t Head(uint32_t slot, uint64_t previous) { return ((previous >> 32) + 1) << 32 | slot; }
+    static uint32_t Top(uint64_t head) { return static_cast<uint32_t>(head); }
+
+    uint32_t Pop()
+    {
+        uint64_t head = mHead.load(std::memory_order_acquire);
+        while(Top(head) != kNone)
+        {
+            uint32_t next = mSlots[Top(head)]->next.load(std::memory_order_relaxed);
+            if(mHead.compare_exchange_weak(head, Head(next, head), std::memory_order_acquire, std::memory_order_acquire))
+            {
+                return Top(head);
+            }
+        }
+        return kNone;
+    }
+
+    void Push(uint32_t slot)
+    {
+        uint64_t head = mHead.load(std::memory_order_relaxed);
+        do
+        {
+            mSlots[slot]->next.store(Top(head), std::memory_order_relaxed);
+        } while(!mHead.compare_exchange_weak(head, Head(slot, head), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    uint32_t WaitForSlot(std::chrono::microseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mWaitMutex);
+        mWaiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t slot = kNone;
+        mFreed.wait_for(lock, timeout, [&] { return (slot = Pop()) != kNone; });
+        mWaiters.fetch_sub(1, std::memory_order_relaxed);
+        return slot;
+    }
+
+    void Release(uint32_t slot, std::chrono::steady_clock::time_point leased)
+    {
+        std::chrono::duration<double, std::nano> busy = std::chrono::steady_clock::now() - leased;
+        mBusyNs.fetch_add(static_cast<uint64_t>(busy.count()), std::memory_order_relaxed);
+        mInUse.fetch_sub(1, std::memory_order_relaxed);
+
+        Push(slot);
+        // Pairs with the fence in WaitForSlot: either the waiter's next Pop sees this
+        // slot, or we see the waiter and wake it. Taking the mutex orders the notify after
+        // the waiter started waiting.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(mWaiters.load(std::memory_order_relaxed) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mWaitMutex);
+            }
+            mFreed.notify_one();
+        }
+    }
+
+    std::vector<std::unique_ptr<Slot>> mSlots;
+    alignas(64) std::atomic<uint64_t> mHead{kNone};
+    std::atomic<size_t> mWaiters{0};
+    std::mutex mWaitMutex;
+    std::condition_variable mFreed;
+
+    std::chrono::microseconds mWaitTimeout;
+    std::chrono::steady_clock::time_point mCreated;
+    std::atomic<uint64_t> mLeases{0};
+    std::atomic<uint64_t> mWaits{0};
+    std::atomic<uint64_t> mTimeouts{0};
+    std::atomic<size_t> mInUse{0};
+    std::atomic<size_t> mPeakInUse{0};
+    std::atomic<uint64_t> mBusyNs{0};
+};
+
+int main(int argc, char* argv[])
 {
-    DataBaseInterface *realDb = new DataBase();
+    if(argc > 1 && std::string(argv[1]) == "--harness")
+    {
+        RunHarness(argc, argv);
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return RunChecks();
+    }
+
+    TRACE_SESSION("proxy.trace.json");
+
+    DataBaseInterface *realDb = new LazyDataBaseProxy();
     DataBaseInterface *dbLoggerProxy = new DataPaceLoggingProxy(realDb);
 
     dbLoggerProxy->Query("this_is_a_query");
@@ -66,5 +387,189 @@ int main()
     delete realDb;
     delete dbLoggerProxy;
 
+    PooledDataBase pool(4);
+    pool.Query("this_is_a_pooled_query");
+    PooledDataBase::Stats stats = pool.stats();
+    std::cout << "Pool: " << stats.leases << (stats.leases == 1 ? " query, " : " queries, ") << stats.connected << " of " << pool.size()
+              << " backends connected" << std::endl;
+
     return 0;
-}
\ No newline at end of file
+}
+
+///////////////////////////// Benchmarks ////////////////////////////////////
+
+void RunHarness(int argc, char* argv[])
+{
+    bench::Harness harness("proxy", argc, argv);
+    bench::MuteStdout mute;
+
+    const size_t queries = 1000;
+    DataBase realDb;
+    DataPaceLoggingProxy loggingProxy(&realDb);
+    DataBaseInterface* direct = &realDb;
+    DataBaseInterface* proxied = &loggingProxy;
+
+    harness.run("query direct", queries, [&] {
+        for(size_t i = 0; i < queries; ++i)
+        {
+            bench::DoNotOptimize(direct->Query("select * from orders"));
+        }
+    });
+    harness.run("query through logging proxy", queries, [&] {
+        for(size_t i = 0; i < queries; ++i)
+        {
+            bench::DoNotOptimize(proxied->Query("select * from orders"));
+        }
+    });
+
+    // Startup with a 2 ms connect: the eager backend pays it in its constructor, the proxies
+    // only when they are first queried.
+    const BackendCost slowConnect{std::chrono::milliseconds(2), std::chrono::microseconds(0)};
+    harness.run("startup: eager backend", 1, [&] { DataBase db(slowConnect); });
+    harness.run("startup: lazy proxy", 1, [&] { LazyDataBaseProxy db(slowConnect); });
+    harness.run("startup: lazy proxy + first query", 1, [&] {
+        LazyDataBaseProxy db(slowConnect);
+        bench::DoNotOptimize(db.Query("select 1"));
+    });
+    harness.run("startup: pool of 8", 1, [&] { PooledDataBase db(8, slowConnect); });
+
+    // Pool overhead: one thread, so every lease is a pop and a push.
+    PooledDataBase uncontended(8);
+    harness.run("query through pool, uncontended", queries, [&] {
+        for(size_t i = 0; i < queries; ++i)
+        {
+            bench::DoNotOptimize(uncontended.Query("select * from orders"));
+        }
+    });
+
+    // 8 threads, each query waits 50 us for the server. A shared backend serves one query at
+    // a time; a pool overlaps as many as it has backends.
+    const BackendCost roundTrip{std::chrono::microseconds(0), std::chrono::microseconds(50)};
+    const size_t threads = 8;
+    const size_t perThread = 50;
+    auto runClients = [&](DataBaseInterface& db) {
+        std::vector<std::thread> clients;
+        for(size_t t = 0; t < threads; ++t)
+        {
+            clients.emplace_back([&] {
+                for(size_t i = 0; i < perThread; ++i)
+                {
+                    bench::DoNotOptimize(db.Query("select * from orders"));
+                }
+            });
+        }
+        for(auto& client : clients)
+        {
+            client.join();
+        }
+    };
+
+    DataBase sharedBackend(roundTrip);
+    LockingDataBaseProxy shared(&sharedBackend);
+    harness.run("8 threads: one shared backend", threads * perThread, [&] { runClients(shared); });
+
+    for(size_t size : {2, 8})
+    {
+        PooledDataBase pool(size, roundTrip);
+        harness.run("8 threads: pool of " + std::to_string(size), threads * perThread, [&] { runClients(pool); });
+
+        PooledDataBase::Stats stats = pool.stats();
+        harness.note("%.0f%% utilized, %llu of %llu leases waited, peak %zu in use, %zu connected",
+                     stats.utilization * 100, static_cast<unsigned long long>(stats.waits),
+                     static_cast<unsigned long long>(stats.leases), stats.peakInUse, stats.connected);
+    }
+
+    // Every backend is leased out, so each query waits out its 20 us timeout and throws.
+    const size_t timedOut = 100;
+    PooledDataBase exhausted(1, {}, std::chrono::microseconds(20));
+    PooledDataBase::Lease held = exhausted.Acquire(std::chrono::microseconds(0));
+    harness.run("query through pool, 20 us timeout", timedOut, [&] {
+        for(size_t i = 0; i < timedOut; ++i)
+        {
+            try
+            {
+                bench::DoNotOptimize(exhausted.Query("select * from orders"));
+            }
+            catch(const PoolTimeout&)
+            {
+            }
+        }
+    });
+    harness.note("%llu timeouts, warm-up included", static_cast<unsigned long long>(exhausted.stats().timeouts));
+
+#if TRACE_ENABLED
+    // Cost of one span, recorded and exported later. The buffer is emptied every repetition
+    // so spans are really recorded instead of dropped.
+    const size_t spans = 1000;
+    harness.run("empty trace span", spans, [&] {
+        trace::ThisThread().clear();
+        for(size_t i = 0; i < spans; ++i)
+        {
+            TRACE_SPAN("empty");
+        }
+    });
+#endif
+}
+
+///////////////////////////// Checks ////////////////////////////////////
+
+//! \brief: With its only backend leased out, a pool must throw once the wait times out and
+//!         count the timeout, then serve queries again once the lease is returned.
+void CheckPoolTimeout()
+{
+    PooledDataBase pool(1, {}, std::chrono::milliseconds(2));
+    {
+        PooledDataBase::Lease held = pool.Acquire(std::chrono::microseconds(0));
+        CHECK(held);
+        CHECK(pool.stats().timeouts == 0);
+
+        bool threw = false;
+        try
+        {
+            pool.Query("select 1");
+        }
+        catch(const PoolTimeout&)
+        {
+            threw = true;
+        }
+        CHECK(threw);
+        CHECK(pool.stats().timeouts == 1);
+        CHECK(pool.stats().waits == 1);
+        CHECK(!pool.Acquire(std::chrono::microseconds(0)));
+        CHECK(pool.stats().timeouts == 2);
+    }
+    CHECK(pool.Query("select 1") == "query_result");
+    CHECK(pool.stats().timeouts == 2);
+    CHECK(pool.stats().inUse == 0);
+}
+
+//! \brief: A waiter must get the backend another thread returns before its timeout expires.
+void CheckPoolWaiterWakes()
+{
+    PooledDataBase pool(1, {}, std::chrono::seconds(5));
+    std::atomic<bool> leased{false};
+    std::thread holder([&] {
+        PooledDataBase::Lease lease = pool.Acquire(std::chrono::microseconds(0));
+        leased = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    });
+    while(!leased)
+    {
+        std::this_thread::yield();
+    }
+    CHECK(pool.Query("select 1") == "query_result");
+    holder.join();
+
+    PooledDataBase::Stats stats = pool.stats();
+    CHECK(stats.waits == 1);
+    CHECK(stats.timeouts == 0);
+    CHECK(stats.leases == 2);
+    CHECK(stats.peakInUse == 1);
+}
+
+int RunChecks()
+{
+    CheckPoolTimeout();
+    CheckPoolWaiterWakes();
+    return check::Report("proxy");
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// Minimal self-checks for the pattern examples.
+//
+// Examples with checks handle `--check` by calling their RunChecks(), which uses CHECK()
+// and returns check::Report(). `make check` (in the example or at the root) runs them and
+// fails if any check failed:
+//
+//     int RunChecks()
+//     {
+//         CHECK(pool.stats().timeouts == 1);
+//         return check::Report("proxy");
+//     }
+
+#include <cstddef>
+#include <iostream>
+
+namespace check
+{
+
+struct Counts
+{
+    size_t run = 0;
+    size_t failed = 0;
+};
+
+inline Counts& Totals()
+{
+    static Counts counts;
+    return counts;
+}
+
+inline void Expect(bool passed, const char* expression, const char* file, int line)
+{
+    ++Totals().run;
+    if(!passed)
+    {
+        ++Totals().failed;
+        std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+    }
+}
+
+//! \returns: process exit code, 0 if every check passed.
+inline int Report(const char* suite)
+{
+    std::cerr << suite << ": " << Totals().run - Totals().failed << " of " << Totals().run << " checks passed" << std::endl;
+    return Totals().failed == 0 ? 0 : 1;
+}
+
+} // namespace check
+
+#define CHECK(expression) ::check::Expect(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
@@ -0,0 +1,331 @@
+#pragma once
+
+// Small span tracer for the pattern examples.
+//
+//     TRACE_SESSION("proxy.trace.json");          // in main: writes the trace on scope exit
+//     TRACE_SPAN("DataBase::Query");              // in any function: times the enclosing scope
+//
+// Spans are recorded into a buffer owned by the calling thread, so recording takes no lock:
+// two TSC reads and one store. Names must be string literals (only the pointer is kept).
+// A full buffer drops further spans and counts them. The session writes every thread's
+// spans in Chrome trace-event JSON, open it in chrome://tracing or ui.perfetto.dev.
+//
+// When a thread exits, its spans are copied out and its buffer is handed to the next thread
+// that starts tracing, so the buffers in use never outnumber the live threads. The spans of
+// exited threads are released once a session has written them.
+//
+// Everything compiles to nothing unless TRACE_ENABLED is defined to 1 (`make trace`).
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#if TRACE_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace trace
+{
+
+inline uint64_t Now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct Event
+{
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Events of one thread. Only the owning thread appends; `size` is published with release
+// ordering so the exporter can read every event below it.
+class ThreadBuffer
+{
+public:
+    static constexpr size_t kCapacity = 1 << 16;
+
+    explicit ThreadBuffer(uint32_t tid) : mTid(tid), mEvents(new Event[kCapacity]) {}
+
+    //! \brief: Empties the buffer for a new owner thread. Only while no thread owns it.
+    void reset(uint32_t tid)
+    {
+        mTid = tid;
+        mSize.store(0, std::memory_order_relaxed);
+        mDropped.store(0, std::memory_order_relaxed);
+    }
+
+    void record(const char* name, uint64_t start, uint64_t end)
+    {
+        size_t size = mSize.load(std::memory_order_relaxed);
+        if(size == kCapacity)
+        {
+            mDropped.store(mDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        mEvents[size] = Event{name, start, end};
+        mSize.store(size + 1, std::memory_order_release);
+    }
+
+    //! \brief: Forgets the recorded events. Only from the owning thread, while not exporting.
+    void clear() { mSize.store(0, std::memory_order_release); }
+
+    uint32_t tid() const { return mTid; }
+    size_t size() const { return mSize.load(std::memory_order_acquire); }
+    const Event& at(size_t i) const { return mEvents[i]; }
+    uint64_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+private:
+    uint32_t mTid;
+    std::unique_ptr<Event[]> mEvents;
+    std::atomic<size_t> mSize{0};
+    std::atomic<uint64_t> mDropped{0};
+};
+
+// Spans of a thread that has exited, kept until a session writes them.
+struct FinishedThread
+{
+    uint32_t tid;
+    std::vector<Event> events;
+    uint64_t dropped;
+};
+
+// Owns every thread's buffer. Buffers of exited threads are reused, their spans are kept
+// in FinishedThread records until exported.
+class Registry
+{
+public:
+    static Registry& Instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    //! \brief: A buffer for the calling thread, a free one if there is any.
+    ThreadBuffer* acquire()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        uint32_t tid = ++mLastTid;
+        if(mFree.empty())
+        {
+            mActive.push_back(std::make_unique<ThreadBuffer>(tid));
+        }
+        else
+        {
+            mFree.back()->reset(tid);
+            mActive.push_back(std::move(mFree.back()));
+            mFree.pop_back();
+        }
+        return mActive.back().get();
+    }
+
+    //! \brief: Called by the owning thread as it exits: copies its spans out and frees the buffer.
+    void release(ThreadBuffer* buffer)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if(buffer->size() > 0 || buffer->dropped() > 0)
+        {
+            mFinished.push_back(FinishedThread{buffer->tid(), std::vector<Event>(&buffer->at(0), &buffer->at(0) + buffer->size()),
+                                               buffer->dropped()});
+        }
+        for(auto it = mActive.begin(); it != mActive.end(); ++it)
+        {
+            if(it->get() == buffer)
+            {
+                mFree.push_back(std::move(*it));
+                mActive.erase(it);
+                break;
+            }
+        }
+    }
+
+    //! \brief: Calls visit(tid, events, size, dropped) for every live and exited thread.
+    template<class Visit>
+    void forEach(Visit&& visit)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for(auto& buffer : mActive)
+        {
+            size_t size = buffer->size();
+            visit(buffer->tid(), size > 0 ? &buffer->at(0) : nullptr, size, buffer->dropped());
+        }
+        for(const FinishedThread& thread : mFinished)
+        {
+            visit(thread.tid, thread.events.data(), thread.events.size(), thread.dropped);
+        }
+    }
+
+    //! \brief: Releases the spans of exited threads, once they have been written.
+    void clearFinished()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinished.clear();
+        mFinished.shrink_to_fit();
+    }
+
+    size_t buffers() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mActive.size() + mFree.size();
+    }
+
+private:
+    mutable std::mutex mMutex;
+    uint32_t mLastTid = 0;
+    std::vector<std::unique_ptr<ThreadBuffer>> mActive;
+    std::vector<std::unique_ptr<ThreadBuffer>> mFree;
+    std::vector<FinishedThread> mFinished;
+};
+
+// Holds the calling thread's buffer and gives it back when the thread exits.
+class ThreadSlot
+{
+public:
+    ThreadSlot() : mBuffer(Registry::Instance().acquire()) {}
+    ~ThreadSlot() { Registry::Instance().release(mBuffer); }
+
+    ThreadSlot(const ThreadSlot&) = delete;
+    ThreadSlot& operator=(const ThreadSlot&) = delete;
+
+    ThreadBuffer& buffer() { return *mBuffer; }
+
+private:
+    ThreadBuffer* mBuffer;
+};
+
+//! \brief: Buffer of the calling thread, registered on first use.
+inline ThreadBuffer& ThisThread()
+{
+    thread_local ThreadSlot slot;
+    return slot.buffer();
+}
+
+class Span
+{
+public:
+    explicit Span(const char* name) : mName(name), mStart(Now()) {}
+
+    // The end is read before ThisThread(), so a thread's first span does not include
+    // registering its buffer.
+    ~Span()
+    {
+        uint64_t end = Now();
+        ThisThread().record(mName, mStart, end);
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* mName;
+    uint64_t mStart;
+};
+
+// Marks the time origin of the trace and writes it to `path` when it goes out of scope.
+// The TSC rate is calibrated against steady_clock over the lifetime of the session.
+class Session
+{
+public:
+    explicit Session(std::string path)
+        : mPath(std::move(path)), mStartTicks(Now()), mStartTime(std::chrono::steady_clock::now()) {}
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    ~Session()
+    {
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - mStartTime;
+        uint64_t ticks = Now() - mStartTicks;
+        double ticksPerUs = elapsed.count() > 0 ? ticks / elapsed.count() : 1.0;
+        write(ticksPerUs);
+    }
+
+private:
+    void write(double ticksPerUs) const
+    {
+        std::ofstream out(mPath);
+        if(!out)
+        {
+            std::cerr << "trace: cannot write " << mPath << std::endl;
+            return;
+        }
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        uint64_t dropped = 0;
+        Registry::Instance().forEach([&](uint32_t tid, const Event* events, size_t size, uint64_t threadDropped) {
+            for(size_t i = 0; i < size; ++i)
+            {
+                const Event& event = events[i];
+                if(event.start < mStartTicks)
+                {
+                    continue;
+                }
+                out << (first ? "\n" : ",\n") << "{\"name\":\"" << Escaped(event.name)
+                    << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                    << ",\"ts\":" << (event.start - mStartTicks) / ticksPerUs
+                    << ",\"dur\":" << (event.end - event.start) / ticksPerUs << "}";
+                first = false;
+            }
+            dropped += threadDropped;
+        });
+        out << "\n]}\n";
+        Registry::Instance().clearFinished();
+
+        if(dropped > 0)
+        {
+            std::cerr << "trace: " << dropped << " spans dropped, buffers were full" << std::endl;
+        }
+    }
+
+    static std::string Escaped(const char* text)
+    {
+        std::string escaped;
+        for(; *text; ++text)
+        {
+            if(*text == '"' || *text == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += *text;
+        }
+        return escaped;
+    }
+
+    std::string mPath;
+    uint64_t mStartTicks;
+    std::chrono::steady_clock::time_point mStartTime;
+};
+
+} // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) ::trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_SESSION(path) ::trace::Session TRACE_CONCAT(traceSession, __LINE__)(path)
+
+#else
+
+#define TRACE_SPAN(name) ((void)0)
+#define TRACE_SESSION(path) ((void)0)
+
+#endif